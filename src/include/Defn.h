@@ -105,6 +105,7 @@ extern0 SEXP    R_dot_GenericCallEnv;  /* ".GenericCallEnv" */
 extern0 SEXP    R_dot_GenericDefEnv;  /* ".GenericDefEnv" */
 
 extern0 SEXP	R_StringHash;       /* Global hash of CHARSXPs */
+extern0 SEXP	R_MatchCache;       /* Weak cache of match() hash tables */
 
 
  /* writable char access for R internal use only */
@@ -464,6 +465,11 @@ typedef struct {
 #define UNSET_NO_SPECIAL_SYMBOLS(b) ((b)->sxpinfo.gp &= (~SPECIAL_SYMBOL_MASK))
 #define NO_SPECIAL_SYMBOLS(b) ((b)->sxpinfo.gp & SPECIAL_SYMBOL_MASK)
 
+/* symbols whose lookup results are held in the S3 method cache */
+#define S3_METHOD_SYM_MASK (1<<10)
+#define SET_S3_METHOD_SYM(b) ((b)->sxpinfo.gp |= S3_METHOD_SYM_MASK)
+#define IS_S3_METHOD_SYM(b) ((b)->sxpinfo.gp & S3_METHOD_SYM_MASK)
+
 #else /* USE_RINTERNALS */
 
 typedef struct VECREC *VECP;
@@ -496,6 +502,9 @@ void (SET_NO_SPECIAL_SYMBOLS)(SEXP b);
 void (UNSET_NO_SPECIAL_SYMBOLS)(SEXP b);
 Rboolean (NO_SPECIAL_SYMBOLS)(SEXP b);
 
+void (SET_S3_METHOD_SYM)(SEXP b);
+Rboolean (IS_S3_METHOD_SYM)(SEXP b);
+
 #endif /* USE_RINTERNALS */
 
 /* The byte code engine uses a typed stack. The typed stack's entries
@@ -689,6 +698,13 @@ extern0 int	R_BCIntActive INI_as(0); /* bcEval called more recently than
                                             eval */
 extern0 void*	R_BCpc INI_as(NULL);/* current byte code instruction */
 extern0 SEXP	R_BCbody INI_as(NULL); /* current byte code object */
+extern0 unsigned int R_S3MethodCacheEpoch INI_as(0); /* see objects.c */
+extern0 unsigned int R_NamespaceCacheEpoch INI_as(0); /* see envir.c */
+/* Invalidate the S3 method cache if a binding of 'sym' may have changed */
+#define R_FlushS3MethodCache(sym) do {		\
+	if (IS_S3_METHOD_SYM(sym))		\
+	    R_S3MethodCacheEpoch++;		\
+    } while (0)
 extern0 SEXP	R_NHeap;	    /* Start of the cons cell heap */
 extern0 SEXP	R_FreeSEXP;	    /* Cons cell free list */
 extern0 R_size_t R_Collected;	    /* Number of free cons cells (after gc) */
@@ -1225,11 +1241,24 @@ SEXP mkCLOSXP(SEXP, SEXP, SEXP);
 SEXP mkFalse(void);
 SEXP mkPRIMSXP (int, int);
 SEXP mkPROMISE(SEXP, SEXP);
+/* A string to be made into a CHARSXP by R_mkCharLenCEs (envir.c) */
+typedef struct {
+    const char *name;
+    int len;
+    cetype_t enc;
+} R_CharSpec;
+void R_mkCharLenCEs(SEXP, R_xlen_t, const R_CharSpec *, int);
 SEXP R_mkEVPROMISE(SEXP, SEXP);
 SEXP R_mkEVPROMISE_NR(SEXP, SEXP);
 SEXP mkQUOTE(SEXP);
 SEXP mkSYMSXP(SEXP, SEXP);
 SEXP mkTrue(void);
+/* Private file mappings and views of them, used by readRDS(mmap = TRUE) */
+SEXP R_mmap_region(SEXP, R_size_t *);
+SEXP R_mmap_view(SEXP, SEXPTYPE, R_size_t, R_xlen_t);
+SEXP R_lazy_list(SEXP, R_xlen_t);
+SEXP R_unserializeListElt(SEXP, R_xlen_t);
+void R_force_lazy_lists(SEXP);
 const char *R_nativeEncoding(void);
 SEXP NewEnvironment(SEXP, SEXP, SEXP);
 void onintr(void);
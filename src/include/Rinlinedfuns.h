@@ -202,6 +202,12 @@ INLINE_FUN R_xlen_t XLENGTH_EX(SEXP x)
     return ALTREP(x) ? ALTREP_LENGTH(x) : STDVEC_LENGTH(x);
 }
 
+/* ALTREP lists compute their elements on demand */
+INLINE_FUN SEXP VECTOR_ELT_EX(SEXP x, R_xlen_t i)
+{
+    return ALTREP(x) ? ALTLIST_ELT(x, i) : ((SEXP *) STDVEC_DATAPTR(x))[i];
+}
+
 INLINE_FUN R_xlen_t XTRUELENGTH(SEXP x)
 {
     return ALTREP(x) ? ALTREP_TRUELENGTH(x) : STDVEC_TRUELENGTH(x);
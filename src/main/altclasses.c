@@ -1403,6 +1403,293 @@ SEXP attribute_hidden do_munmap_file(SEXP call, SEXP op, SEXP args, SEXP env)
 }
 
 
+/**
+ ** Memory Mapped Views
+ **/
+
+/* Views are used by readRDS(mmap = TRUE) for the contents of large
+   atomic vectors in a file in the aligned binary serialization
+   format (see serialize.c).  The file is mapped once, privately, by
+   R_mmap_region and the views refer to parts of the mapping, which is
+   unmapped when the region and all the views of it are no longer
+   reachable.
+
+   View objects are ALTREP objects with data fields
+
+       data1: the region, an external pointer to the mapped address
+              with the size of the mapping as its Protected field
+       data2: the offset and length of the view in a REALSXP
+
+   Views are marked as not mutable, so R duplicates them before
+   modifying them.  As the mapping is private, writes through a data
+   pointer obtained by C code only change this process's copy of the
+   pages, never the file. */
+
+static R_altrep_class_t mmap_view_logical_class;
+static R_altrep_class_t mmap_view_integer_class;
+static R_altrep_class_t mmap_view_real_class;
+static R_altrep_class_t mmap_view_raw_class;
+
+#define MMAP_VIEW_REGION(x) R_altrep_data1(x)
+#define MMAP_VIEW_OFFSET(x) ((size_t) REAL_ELT(R_altrep_data2(x), 0))
+#define MMAP_VIEW_LENGTH(x) ((R_xlen_t) REAL_ELT(R_altrep_data2(x), 1))
+
+#ifdef Win32
+SEXP attribute_hidden R_mmap_region(SEXP file, R_size_t *size)
+{
+    error("mmap objects not supported on Windows yet");
+}
+#else
+static void mmap_region_finalize(SEXP eptr)
+{
+    void *p = R_ExternalPtrAddr(eptr);
+    size_t size = (size_t) REAL_ELT(R_ExternalPtrProtected(eptr), 0);
+
+    if (p != NULL) {
+	munmap(p, size); /* don't check for errors */
+	R_SetExternalPtrAddr(eptr, NULL);
+    }
+}
+
+SEXP attribute_hidden R_mmap_region(SEXP file, R_size_t *size)
+{
+    const char *efn = R_ExpandFileName(translateCharFP(STRING_ELT(file, 0)));
+    struct stat sb;
+
+    if (stat(efn, &sb) != 0)
+	error("stat: %s", strerror(errno));
+    if (! S_ISREG(sb.st_mode))
+	error("%s is not a regular file", efn);
+
+    SEXP ssize = PROTECT(ScalarReal((double) sb.st_size));
+    int fd = open(efn, O_RDONLY);
+    if (fd == -1)
+	error("open: %s", strerror(errno));
+    void *p = mmap(0, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); /* don't care if this fails */
+    if (p == MAP_FAILED)
+	error("mmap: %s", strerror(errno));
+
+    SEXP eptr = R_MakeExternalPtr(p, R_NilValue, ssize);
+    R_RegisterCFinalizerEx(eptr, mmap_region_finalize, TRUE);
+    UNPROTECT(1); /* ssize */
+    *size = sb.st_size;
+    return eptr;
+}
+#endif
+
+SEXP attribute_hidden R_mmap_view(SEXP region, SEXPTYPE type,
+				  R_size_t offset, R_xlen_t n)
+{
+    R_altrep_class_t class;
+    switch(type) {
+    case LGLSXP: class = mmap_view_logical_class; break;
+    case INTSXP: class = mmap_view_integer_class; break;
+    case REALSXP: class = mmap_view_real_class; break;
+    case RAWSXP: class = mmap_view_raw_class; break;
+    default: error("mmap for %s not supported yet", type2char(type));
+    }
+
+    SEXP state = PROTECT(allocVector(REALSXP, 2));
+    REAL(state)[0] = (double) offset;
+    REAL(state)[1] = (double) n;
+    SEXP ans = R_new_altrep(class, region, state);
+    MARK_NOT_MUTABLE(ans);
+    UNPROTECT(1); /* state */
+    return ans;
+}
+
+static Rboolean mmap_view_Inspect(SEXP x, int pre, int deep, int pvec,
+				  void (*inspect_subtree)(SEXP, int, int, int))
+{
+    Rprintf(" mmaped view of %s at offset %.0f\n", type2char(TYPEOF(x)),
+	    (double) MMAP_VIEW_OFFSET(x));
+    return TRUE;
+}
+
+static R_xlen_t mmap_view_Length(SEXP x)
+{
+    return MMAP_VIEW_LENGTH(x);
+}
+
+static void *mmap_view_Dataptr(SEXP x, Rboolean writeable)
+{
+    char *addr = R_ExternalPtrAddr(MMAP_VIEW_REGION(x));
+
+    if (addr == NULL)
+	error("object has been unmapped");
+    return addr + MMAP_VIEW_OFFSET(x);
+}
+
+static const void *mmap_view_Dataptr_or_null(SEXP x)
+{
+    return mmap_view_Dataptr(x, FALSE);
+}
+
+static void InitMmapViewMethods(R_altrep_class_t cls)
+{
+    R_set_altrep_Inspect_method(cls, mmap_view_Inspect);
+    R_set_altrep_Length_method(cls, mmap_view_Length);
+    R_set_altvec_Dataptr_method(cls, mmap_view_Dataptr);
+    R_set_altvec_Dataptr_or_null_method(cls, mmap_view_Dataptr_or_null);
+}
+
+static void InitMmapViewClasses(DllInfo *dll)
+{
+    mmap_view_logical_class =
+	R_make_altlogical_class("mmap_view_logical", MMAPPKG, dll);
+    InitMmapViewMethods(mmap_view_logical_class);
+    mmap_view_integer_class =
+	R_make_altinteger_class("mmap_view_integer", MMAPPKG, dll);
+    InitMmapViewMethods(mmap_view_integer_class);
+    mmap_view_real_class =
+	R_make_altreal_class("mmap_view_real", MMAPPKG, dll);
+    InitMmapViewMethods(mmap_view_real_class);
+    mmap_view_raw_class =
+	R_make_altraw_class("mmap_view_raw", MMAPPKG, dll);
+    InitMmapViewMethods(mmap_view_raw_class);
+}
+
+
+/**
+ ** Lazy Lists
+ **/
+
+/* Lazy lists are returned by readRDS() for files written by
+   saveRDS(lazy = TRUE), in which each element of a list is
+   serialized separately.  An element is only read from the file and
+   unserialized, by R_unserializeListElt in serialize.c, when it is
+   first used.
+
+   Lazy list objects are ALTREP objects with data fields
+
+       data1: what is needed to read the elements: a list of the file
+              name, the offsets of the elements, the size, device,
+              inode and modification time of the file, the compression
+              type and the refhook
+       data2: a list of the elements, with R_UnboundValue for those
+              not read yet
+
+   Elements are read only once, and assignments change the elements
+   in data2.  Getting a data pointer reads all the remaining elements.
+   The objects are serialized and duplicated as ordinary lists, except
+   that duplicates share the elements not read yet. */
+
+static R_altrep_class_t lazy_list_class;
+
+#define LAZY_LIST_INFO(x) R_altrep_data1(x)
+#define LAZY_LIST_ELTS(x) R_altrep_data2(x)
+
+static SEXP lazy_list_Duplicate(SEXP x, Rboolean deep)
+{
+    SEXP elts = LAZY_LIST_ELTS(x);
+    PROTECT(elts = deep ? duplicate(elts) : shallow_duplicate(elts));
+    SEXP ans = R_new_altrep(lazy_list_class, LAZY_LIST_INFO(x), elts);
+    UNPROTECT(1); /* elts */
+    return ans;
+}
+
+static Rboolean lazy_list_Inspect(SEXP x, int pre, int deep, int pvec,
+				  void (*inspect_subtree)(SEXP, int, int, int))
+{
+    SEXP elts = LAZY_LIST_ELTS(x);
+    R_xlen_t n = XLENGTH(elts), nread = 0;
+    for (R_xlen_t i = 0; i < n; i++)
+	if (VECTOR_ELT(elts, i) != R_UnboundValue)
+	    nread++;
+    Rprintf(" lazy list, %.0f of %.0f elements read from %s\n",
+	    (double) nread, (double) n,
+	    CHAR(STRING_ELT(VECTOR_ELT(LAZY_LIST_INFO(x), 0), 0)));
+    return TRUE;
+}
+
+static R_xlen_t lazy_list_Length(SEXP x)
+{
+    return XLENGTH(LAZY_LIST_ELTS(x));
+}
+
+static SEXP lazy_list_Elt(SEXP x, R_xlen_t i)
+{
+    SEXP elts = LAZY_LIST_ELTS(x);
+    SEXP val = VECTOR_ELT(elts, i);
+    if (val == R_UnboundValue) {
+	PROTECT(x);
+	val = R_unserializeListElt(LAZY_LIST_INFO(x), i);
+	SET_VECTOR_ELT(elts, i, val);
+	UNPROTECT(1); /* x */
+    }
+    return val;
+}
+
+static void lazy_list_Set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+    SET_VECTOR_ELT(LAZY_LIST_ELTS(x), i, v);
+}
+
+static void *lazy_list_Dataptr(SEXP x, Rboolean writeable)
+{
+    R_xlen_t n = XLENGTH(x);
+    for (R_xlen_t i = 0; i < n; i++)
+	lazy_list_Elt(x, i);
+    return DATAPTR(LAZY_LIST_ELTS(x));
+}
+
+static void InitLazyListClass(DllInfo *dll)
+{
+    R_altrep_class_t cls = R_make_altlist_class("lazy_list", "base", dll);
+    lazy_list_class = cls;
+
+    R_set_altrep_Duplicate_method(cls, lazy_list_Duplicate);
+    R_set_altrep_Inspect_method(cls, lazy_list_Inspect);
+    R_set_altrep_Length_method(cls, lazy_list_Length);
+    R_set_altvec_Dataptr_method(cls, lazy_list_Dataptr);
+    R_set_altlist_Elt_method(cls, lazy_list_Elt);
+    R_set_altlist_Set_elt_method(cls, lazy_list_Set_elt);
+}
+
+/* Reads the elements not yet read of the lazy lists in x, looking in
+   the elements and attributes of lists and in pairlists.  Used before
+   writing to a file, which may be one the lazy lists are read from. */
+static Rboolean lazy_lists_made = FALSE;
+
+static void force_lazy_lists(SEXP x)
+{
+    R_CheckStack();
+    for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a))
+	force_lazy_lists(CAR(a));
+    switch(TYPEOF(x)) {
+    case VECSXP:
+    case EXPRSXP:
+	for (R_xlen_t i = 0; i < XLENGTH(x); i++)
+	    force_lazy_lists(VECTOR_ELT(x, i));
+	break;
+    case LISTSXP:
+	for (; x != R_NilValue; x = CDR(x))
+	    force_lazy_lists(CAR(x));
+	break;
+    default:
+	break;
+    }
+}
+
+void attribute_hidden R_force_lazy_lists(SEXP x)
+{
+    if (lazy_lists_made)
+	force_lazy_lists(x);
+}
+
+SEXP attribute_hidden R_lazy_list(SEXP info, R_xlen_t n)
+{
+    lazy_lists_made = TRUE;
+    SEXP elts = PROTECT(allocVector(VECSXP, n));
+    for (R_xlen_t i = 0; i < n; i++)
+	SET_VECTOR_ELT(elts, i, R_UnboundValue);
+    SEXP ans = R_new_altrep(lazy_list_class, info, elts);
+    UNPROTECT(1); /* elts */
+    return ans;
+}
+
+
 /**
  ** Attribute and Meta Data Wrappers
  **/
@@ -2025,6 +2312,8 @@ void attribute_hidden R_init_altrep()
     InitDefferredStringClass();
     InitMmapIntegerClass(NULL);
     InitMmapRealClass(NULL);
+    InitMmapViewClasses(NULL);
+    InitLazyListClass(NULL);
     InitWrapIntegerClass(NULL);
     InitWrapLogicalClass(NULL);
     InitWrapRealClass(NULL);
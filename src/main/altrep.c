@@ -134,6 +134,7 @@ static void SET_ALTREP_CLASS(SEXP x, SEXP class)
 #define ALTRAW_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altraw)
 #define ALTCOMPLEX_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altcomplex)
 #define ALTSTRING_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altstring)
+#define ALTLIST_METHODS_TABLE(x) GENERIC_METHODS_TABLE(x, altlist)
 
 #define ALTREP_METHODS						\
     R_altrep_UnserializeEX_method_t UnserializeEX;		\
@@ -196,6 +197,11 @@ static void SET_ALTREP_CLASS(SEXP x, SEXP class)
     R_altstring_Is_sorted_method_t Is_sorted;	\
     R_altstring_No_NA_method_t No_NA
 
+#define ALTLIST_METHODS				\
+    ALTVEC_METHODS;				\
+    R_altlist_Elt_method_t Elt;			\
+    R_altlist_Set_elt_method_t Set_elt
+
 typedef struct { ALTREP_METHODS; } altrep_methods_t;
 typedef struct { ALTVEC_METHODS; } altvec_methods_t;
 typedef struct { ALTINTEGER_METHODS; } altinteger_methods_t;
@@ -204,6 +210,7 @@ typedef struct { ALTLOGICAL_METHODS; } altlogical_methods_t;
 typedef struct { ALTRAW_METHODS; } altraw_methods_t;
 typedef struct { ALTCOMPLEX_METHODS; } altcomplex_methods_t;
 typedef struct { ALTSTRING_METHODS; } altstring_methods_t;
+typedef struct { ALTLIST_METHODS; } altlist_methods_t;
 
 /* Macro to extract first element from ... macro argument.
    From Richard Hansen's answer in
@@ -223,6 +230,7 @@ typedef struct { ALTSTRING_METHODS; } altstring_methods_t;
 #define ALTRAW_DISPATCH(fun, ...) DO_DISPATCH(ALTRAW, fun, __VA_ARGS__)
 #define ALTCOMPLEX_DISPATCH(fun, ...) DO_DISPATCH(ALTCOMPLEX, fun, __VA_ARGS__)
 #define ALTSTRING_DISPATCH(fun, ...) DO_DISPATCH(ALTSTRING, fun, __VA_ARGS__)
+#define ALTLIST_DISPATCH(fun, ...) DO_DISPATCH(ALTLIST, fun, __VA_ARGS__)
 
 
 /*
@@ -531,6 +539,30 @@ void attribute_hidden ALTSTRING_SET_ELT(SEXP x, R_xlen_t i, SEXP v)
     R_GCEnabled = enabled;
 }
 
+/* Unlike ALTSTRING_ELT these do not disable the GC: an Elt method may
+   have to do a lot of work, such as unserializing the element, and
+   can signal errors.  The methods must store the elements they
+   return in the object, so the value is protected as long as the
+   list is. */
+SEXP ALTLIST_ELT(SEXP x, R_xlen_t i)
+{
+    /* internal code also uses VECTOR_ELT on other ALTREP vectors */
+    if (TYPEOF(x) != VECSXP)
+	return ((SEXP *) DATAPTR(x))[i];
+    if (R_in_gc)
+	error("cannot get ALTLIST_ELT during GC");
+    R_CHECK_THREAD;
+    return ALTLIST_DISPATCH(Elt, x, i);
+}
+
+void ALTLIST_SET_ELT(SEXP x, R_xlen_t i, SEXP v)
+{
+    if (R_in_gc)
+	error("cannot set ALTLIST_ELT during GC");
+    R_CHECK_THREAD;
+    ALTLIST_DISPATCH(Set_elt, x, i, v);
+}
+
 int STRING_IS_SORTED(SEXP x)
 {
     return ALTREP(x) ? ALTSTRING_DISPATCH(Is_sorted, x) : UNKNOWN_SORTEDNESS;
@@ -801,6 +833,16 @@ static void altstring_Set_elt_default(SEXP x, R_xlen_t i, SEXP v)
 static int altstring_Is_sorted_default(SEXP x) { return UNKNOWN_SORTEDNESS; }
 static int altstring_No_NA_default(SEXP x) { return 0; }
 
+static SEXP altlist_Elt_default(SEXP x, R_xlen_t i)
+{
+    ALTREP_ERROR_IN_CLASS("No Elt method found for ALTLIST class", x);
+}
+
+static void altlist_Set_elt_default(SEXP x, R_xlen_t i, SEXP v)
+{
+    ALTREP_ERROR_IN_CLASS("No Set_elt found for ALTLIST class", x);
+}
+
 
 /**
  ** ALTREP Initial Method Tables
@@ -925,6 +967,23 @@ static altstring_methods_t altstring_default_methods = {
 };
 
 
+static altlist_methods_t altlist_default_methods = {
+    .UnserializeEX = altrep_UnserializeEX_default,
+    .Unserialize = altrep_Unserialize_default,
+    .Serialized_state = altrep_Serialized_state_default,
+    .DuplicateEX = altrep_DuplicateEX_default,
+    .Duplicate = altrep_Duplicate_default,
+    .Coerce = altrep_Coerce_default,
+    .Inspect = altrep_Inspect_default,
+    .Length = altrep_Length_default,
+    .Dataptr = altvec_Dataptr_default,
+    .Dataptr_or_null = altvec_Dataptr_or_null_default,
+    .Extract_subset = altvec_Extract_subset_default,
+    .Elt = altlist_Elt_default,
+    .Set_elt = altlist_Set_elt_default
+};
+
+
 /**
  ** Class Constructors
  **/
@@ -958,6 +1017,7 @@ make_altrep_class(int type, const char *cname, const char *pname, DllInfo *dll)
     case RAWSXP:  MAKE_CLASS(class, altraw);     break;
     case CPLXSXP: MAKE_CLASS(class, altcomplex); break;
     case STRSXP:  MAKE_CLASS(class, altstring);  break;
+    case VECSXP:  MAKE_CLASS(class, altlist);    break;
     default: error("unsupported ALTREP class");
     }
     RegisterClass(class, type, cname, pname, dll);
@@ -981,6 +1041,7 @@ DEFINE_CLASS_CONSTRUCTOR(altreal, REALSXP)
 DEFINE_CLASS_CONSTRUCTOR(altlogical, LGLSXP)
 DEFINE_CLASS_CONSTRUCTOR(altraw, RAWSXP)
 DEFINE_CLASS_CONSTRUCTOR(altcomplex, CPLXSXP)
+DEFINE_CLASS_CONSTRUCTOR(altlist, VECSXP)
 
 static void reinit_altrep_class(SEXP class)
 {
@@ -991,6 +1052,7 @@ static void reinit_altrep_class(SEXP class)
     case LGLSXP: INIT_CLASS(class, altlogical); break;
     case RAWSXP: INIT_CLASS(class, altraw); break;
     case CPLXSXP: INIT_CLASS(class, altcomplex); break;
+    case VECSXP: INIT_CLASS(class, altlist); break;
     default: error("unsupported ALTREP class");
     }
 }
@@ -1054,6 +1116,9 @@ DEFINE_METHOD_SETTER(altstring, Set_elt)
 DEFINE_METHOD_SETTER(altstring, Is_sorted)
 DEFINE_METHOD_SETTER(altstring, No_NA)
 
+DEFINE_METHOD_SETTER(altlist, Elt)
+DEFINE_METHOD_SETTER(altlist, Set_elt)
+
 
 /**
  ** ALTREP Object Constructor and Utility Functions
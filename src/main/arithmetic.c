@@ -190,8 +190,9 @@ void attribute_hidden InitArithmetic()
 # define c_eps DBL_EPSILON
 #endif
 
-/* Keep myfmod() and myfloor() in step */
-static double myfmod(double x1, double x2)
+/* Keep myfmod() and myfloor() in step.  Also used for the MOD and
+   IDIV byte code instructions in eval.c. */
+double attribute_hidden myfmod(double x1, double x2)
 {
     if (x2 == 0.0) return R_NaN;
     if(fabs(x2) * c_eps > 1 && R_FINITE(x1) && fabs(x1) <= fabs(x2)) {
@@ -209,7 +210,7 @@ static double myfmod(double x1, double x2)
     return (double) (tmp - floorl(tmp/x2) * x2);
 }
 
-static double myfloor(double x1, double x2)
+double attribute_hidden myfloor(double x1, double x2)
 {
     double q = x1 / x2;
     if (x2 == 0.0 || fabs(q) * c_eps > 1 || !R_FINITE(q))
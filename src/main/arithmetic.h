@@ -32,6 +32,8 @@ SEXP complex_unary(ARITHOP_TYPE, SEXP, SEXP);
 SEXP complex_binary(ARITHOP_TYPE, SEXP, SEXP);
 
 double R_pow(double x, double y);
+double myfmod(double x1, double x2);  /* x1 %% x2 */
+double myfloor(double x1, double x2); /* x1 %/% x2 */
 static R_INLINE double R_POW(double x, double y) /* handle x ^ 2 inline */
 {
     return y == 2.0 ? x * x : R_pow(x, y);
@@ -427,6 +427,8 @@ SEXP attribute_hidden do_parentenvgets(SEXP call, SEXP op, SEXP args, SEXP rho)
 	error(_("'parent' is not an environment"));
 
     SET_ENCLOS(env, parent);
+    R_S3MethodCacheEpoch++;
+    R_NamespaceCacheEpoch++;
 
     return( CAR(args) );
 }
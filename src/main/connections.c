@@ -94,6 +94,9 @@ int attribute_hidden R_OutputCon; /* used in printutils.c */
 static void con_destroy(int i);
 
 #include <errno.h>
+#ifdef _OPENMP
+# include <omp.h>  /* for omp_get_num_procs */
+#endif
 
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -1683,8 +1686,77 @@ typedef struct gzconn {
 typedef struct gzfileconn {
     void *fp;
     int compress;
+    int threads;
+    /* for writing with threads > 1 */
+    FILE *mtfp;
+    unsigned char *mtbuf;
+    size_t mtused;
+    double mtpos;
 } *Rgzfileconn;
 
+/* When writing with threads > 1, the data is collected in blocks of
+   GZ_MT_BLOCK bytes, one per thread, which are compressed in parallel
+   as separate gzip members and written out in order.  gzip and
+   R_gzread read such a file as the concatenation of the members. */
+#define GZ_MT_BLOCK 1048576
+
+/* Compress and write out the buffered blocks.  Returns 0 on success,
+   1 if compression failed and 2 if writing failed. */
+static int gzfile_mt_flush(Rgzfileconn gz)
+{
+    int nb = (int)((gz->mtused + GZ_MT_BLOCK - 1) / GZ_MT_BLOCK), failed = 0;
+    if (nb == 0) return 0;
+    unsigned char **out = (unsigned char **) calloc(nb, sizeof(char *));
+    size_t *outlen = (size_t *) calloc(nb, sizeof(size_t));
+    if (!out || !outlen) {
+	free(out); free(outlen);
+	return 1;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(gz->threads) schedule(static)
+#endif
+    for (int b = 0; b < nb; b++) {
+	size_t off = (size_t) b * GZ_MT_BLOCK, len = gz->mtused - off;
+	if (len > GZ_MT_BLOCK) len = GZ_MT_BLOCK;
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	/* windowBits + 16 gives a gzip header and trailer */
+	if (deflateInit2(&strm, gz->compress, Z_DEFLATED, MAX_WBITS + 16,
+			 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+	    failed = 1;
+	    continue;
+	}
+	uLong bound = deflateBound(&strm, (uLong) len);
+	out[b] = (unsigned char *) malloc(bound);
+	if (out[b]) {
+	    strm.next_in = gz->mtbuf + off;
+	    strm.avail_in = (uInt) len;
+	    strm.next_out = out[b];
+	    strm.avail_out = (uInt) bound;
+	    if (deflate(&strm, Z_FINISH) == Z_STREAM_END)
+		outlen[b] = bound - strm.avail_out;
+	    else failed = 1;
+	} else failed = 1;
+	deflateEnd(&strm);
+    }
+
+    for (int b = 0; b < nb; b++) {
+	if (!failed && fwrite(out[b], 1, outlen[b], gz->mtfp) != outlen[b])
+	    failed = 2;
+	free(out[b]);
+    }
+    free(out); free(outlen);
+    gz->mtused = 0;
+    return failed;
+}
+
+static void gzfile_mt_error(int res)
+{
+    if (res == 1) error(_("gzfile compression failed"));
+    if (res == 2) error(_("write error on gzfile"));
+}
+
 static Rboolean gzfile_open(Rconnection con)
 {
     gzFile fp;
@@ -1705,6 +1777,32 @@ static Rboolean gzfile_open(Rconnection con)
 	warning(_("cannot open file '%s': it is a directory"), name);
 	return FALSE;
     }
+    if (gzcon->threads > 1 && mode[0] != 'r') {
+	mode[2] = '\0';
+	gzcon->mtbuf = (unsigned char *) malloc(gzcon->threads * GZ_MT_BLOCK);
+	if(!gzcon->mtbuf) {
+	    warning(_("cannot allocate buffer in gzfile"));
+	    return FALSE;
+	}
+	gzcon->mtfp = R_fopen(name, mode);
+	if(!gzcon->mtfp) {
+	    free(gzcon->mtbuf); gzcon->mtbuf = NULL;
+	    warning(_("cannot open compressed file '%s', probable reason '%s'"),
+		    name, strerror(errno));
+	    return FALSE;
+	}
+	gzcon->mtused = 0;
+	gzcon->mtpos = 0;
+	gzcon->fp = NULL;
+	con->isopen = TRUE;
+	con->canwrite = TRUE;
+	con->canread = FALSE;
+	con->text = strchr(con->mode, 'b') ? FALSE : TRUE;
+	set_buffer(con);
+	set_iconv(con);
+	con->save = -1000;
+	return TRUE;
+    }
     fp = R_gzopen(name, mode);
     if(!fp) {
 	warning(_("cannot open compressed file '%s', probable reason '%s'"),
@@ -1724,7 +1822,17 @@ static Rboolean gzfile_open(Rconnection con)
 
 static void gzfile_close(Rconnection con)
 {
-    R_gzclose(((Rgzfileconn)(con->private))->fp);
+    Rgzfileconn gz = con->private;
+    if (gz->mtfp) {
+	int res = gzfile_mt_flush(gz);
+	free(gz->mtbuf); gz->mtbuf = NULL;
+	if (fclose(gz->mtfp) && !res) res = 2;
+	gz->mtfp = NULL;
+	con->isopen = FALSE;
+	gzfile_mt_error(res);
+	return;
+    }
+    R_gzclose(gz->fp);
     con->isopen = FALSE;
 }
 
@@ -1740,7 +1848,12 @@ static int gzfile_fgetc_internal(Rconnection con)
    When reading, it either seeks forwards or rewinds and reads again */
 static double gzfile_seek(Rconnection con, double where, int origin, int rw)
 {
-    gzFile  fp = ((Rgzfileconn)(con->private))->fp;
+    Rgzfileconn gz = con->private;
+    if (gz->mtfp) {
+	if (ISNA(where)) return gz->mtpos;
+	error(_("cannot seek on a gzfile connection written with threads > 1"));
+    }
+    gzFile  fp = gz->fp;
     Rz_off_t pos = R_gztell(fp);
     int res, whence = SEEK_SET;
 
@@ -1775,7 +1888,21 @@ static size_t gzfile_read(void *ptr, size_t size, size_t nitems,
 static size_t gzfile_write(const void *ptr, size_t size, size_t nitems,
 			   Rconnection con)
 {
-    gzFile fp = ((Rgzfileconn)(con->private))->fp;
+    Rgzfileconn gz = con->private;
+    if (gz->mtfp) {
+	size_t n = size * nitems, cap = (size_t) gz->threads * GZ_MT_BLOCK;
+	const unsigned char *p = ptr;
+	while (n > 0) {
+	    size_t m = cap - gz->mtused;
+	    if (m > n) m = n;
+	    memcpy(gz->mtbuf + gz->mtused, p, m);
+	    gz->mtused += m; p += m; n -= m;
+	    if (gz->mtused == cap) gzfile_mt_error(gzfile_mt_flush(gz));
+	}
+	gz->mtpos += (double) size * nitems;
+	return nitems;
+    }
+    gzFile fp = gz->fp;
     /* uses 'unsigned' for len */
     if ((double) size * (double) nitems > UINT_MAX)
 	error(_("too large a block specified"));
@@ -1783,7 +1910,7 @@ static size_t gzfile_write(const void *ptr, size_t size, size_t nitems,
 }
 
 static Rconnection newgzfile(const char *description, const char *mode,
-			     int compress)
+			     int compress, int threads)
 {
     Rconnection new;
     new = (Rconnection) malloc(sizeof(struct Rconn));
@@ -1819,7 +1946,9 @@ static Rconnection newgzfile(const char *description, const char *mode,
 	error(_("allocation of gzfile connection failed"));
 	/* for Solaris 12.5 */ new = NULL;
     }
+    memset(new->private, 0, sizeof(struct gzfileconn));
     ((Rgzfileconn)new->private)->compress = compress;
+    ((Rgzfileconn)new->private)->threads = threads;
     return new;
 }
 
@@ -2023,6 +2152,7 @@ typedef struct xzfileconn {
     lzma_action action;
     int compress;
     int type;
+    int threads;
     lzma_filter filters[2];
     lzma_options_lzma opt_lzma;
     unsigned char buf[BUFSIZE];
@@ -2076,6 +2206,19 @@ static Rboolean xzfile_open(Rconnection con)
 	xz->filters[0].options = &(xz->opt_lzma);
 	xz->filters[1].id = LZMA_VLI_UNKNOWN;
 
+#if LZMA_VERSION >= 50020002
+	/* the multi-threaded encoder splits the data into blocks which
+	   are compressed independently, in the same .xz format */
+	if (xz->threads != 1) {
+	    lzma_mt mt;
+	    memset(&mt, 0, sizeof(mt));
+	    mt.threads = xz->threads ? xz->threads : lzma_cputhreads();
+	    if (mt.threads == 0) mt.threads = 1;
+	    mt.filters = xz->filters;
+	    mt.check = LZMA_CHECK_CRC32;
+	    ret = lzma_stream_encoder_mt(strm, &mt);
+	} else
+#endif
 	ret = lzma_stream_encoder(strm, xz->filters, LZMA_CHECK_CRC32);
 	if (ret != LZMA_OK) {
 	    warning(_("cannot initialize lzma encoder, error %d"), ret);
@@ -2203,7 +2346,8 @@ static size_t xzfile_write(const void *ptr, size_t size, size_t nitems,
 }
 
 static Rconnection
-newxzfile(const char *description, const char *mode, int type, int compress)
+newxzfile(const char *description, const char *mode, int type, int compress,
+	  int threads)
 {
     Rconnection new;
     new = (Rconnection) malloc(sizeof(struct Rconn));
@@ -2242,6 +2386,7 @@ newxzfile(const char *description, const char *mode, int type, int compress)
     }
     ((Rxzfileconn) new->private)->type = type;
     ((Rxzfileconn) new->private)->compress = compress;
+    ((Rxzfileconn) new->private)->threads = threads;
     return new;
 }
 
@@ -2250,7 +2395,7 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP sfile, sopen, ans, class, enc;
     const char *file, *open;
-    int ncon, compress = 9;
+    int ncon, compress = 9, threads = 1;
     Rconnection con = NULL;
     int type = PRIMVAL(op);
     int subtype = 0;
@@ -2280,6 +2425,22 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
 	if(compress == NA_LOGICAL || abs(compress) > 9)
 	    error(_("invalid '%s' argument"), "compress");
     }
+    if(type != 1) {
+	threads = asInteger(CAD4R(args));
+	if(threads == NA_INTEGER || threads < 0)
+	    error(_("invalid '%s' argument"), "threads");
+	if(type == 0 && threads == 0) {
+#ifdef _OPENMP
+	    /* one per processor, limited as other math threads are */
+	    threads = omp_get_num_procs();
+	    if(threads > R_max_num_math_threads)
+		threads = R_max_num_math_threads;
+	    if(threads < 1) threads = 1;
+#else
+	    threads = 1;
+#endif
+	}
+    }
     open = CHAR(STRING_ELT(sopen, 0)); /* ASCII */
     if (type == 0 && (!open[0] || open[0] == 'r')) {
 	/* check magic no */
@@ -2304,13 +2465,14 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
     }
     switch(type) {
     case 0:
-	con = newgzfile(file, strlen(open) ? open : "rb", compress);
+	con = newgzfile(file, strlen(open) ? open : "rb", compress, threads);
 	break;
     case 1:
 	con = newbzfile(file, strlen(open) ? open : "rb", compress);
 	break;
     case 2:
-	con = newxzfile(file, strlen(open) ? open : "rb", subtype, compress);
+	con = newxzfile(file, strlen(open) ? open : "rb", subtype, compress,
+			threads);
 	break;
     }
     ncon = NextConnection();
@@ -3888,11 +4050,60 @@ static void con_cleanup(void *data)
 
 /* readLines(con = stdin(), n = 1, ok = TRUE, warn = TRUE) */
 #define BUF_SIZE 1000
+
+/* readLines collects the lines it reads in batches, so that the
+   CHARSXPs are made by R_mkCharLenCEs rather than one at a time.
+   Each line is read directly into the batch buffer after the ones
+   before it, so batching copies nothing. */
+#define LINE_BATCH 1024
+typedef struct {
+    char *buf;			/* the lines, nul-terminated, one after another */
+    size_t used, size;
+    int n;			/* number of lines */
+    size_t off[LINE_BATCH];
+    int len[LINE_BATCH];
+} LineBatch;
+
+static void linebatch_grow(LineBatch *b)
+{
+    char *tmp = (char *) realloc(b->buf, 2 * b->size);
+    if (!tmp) error(_("cannot allocate buffer in readLines"));
+    b->buf = tmp;
+    b->size *= 2;
+}
+
+/* Add the line of nbuf bytes just read to b->buf + b->used, omitting
+   its first skip bytes and anything after an embedded nul */
+static void linebatch_add(LineBatch *b, size_t skip, size_t nbuf)
+{
+    size_t len = strlen(b->buf + b->used + skip);
+    if (len > INT_MAX)
+	error(_("line longer than %d bytes"), INT_MAX);
+    b->off[b->n] = b->used + skip;
+    b->len[b->n] = (int) len;
+    b->used += nbuf + 1;
+    b->n++;
+}
+
+/* Set ans[start + i] to the i-th line of the batch, and empty it */
+static void linebatch_flush(LineBatch *b, SEXP ans, R_xlen_t start,
+			    cetype_t enc)
+{
+    R_CharSpec strs[LINE_BATCH];
+    for (int i = 0; i < b->n; i++) {
+	strs[i].name = b->buf + b->off[i];
+	strs[i].len = b->len[i];
+	strs[i].enc = enc;
+    }
+    R_mkCharLenCEs(ans, start, strs, b->n);
+    b->n = 0;
+    b->used = 0;
+}
 SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP ans = R_NilValue, ans2;
     int ok, warn, skipNul, c;
-    size_t nbuf, buf_size = BUF_SIZE;
+    size_t nbuf;
     int oenc = CE_NATIVE;
     Rconnection con = NULL;
     Rboolean wasopen;
@@ -3900,6 +4111,7 @@ SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
     const char *encoding;
     RCNTXT cntxt;
     R_xlen_t i, n, nn, nnn, nread;
+    LineBatch lb;
 
     checkArity(op, args);
     if(!inherits(CAR(args), "connection"))
@@ -3946,14 +4158,18 @@ SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
     if(con->UTF8out || streql(encoding, "UTF-8")) oenc = CE_UTF8;
     else if(streql(encoding, "latin1")) oenc = CE_LATIN1;
 
-    buf = (char *) malloc(buf_size);
-    if(!buf)
+    lb.n = 0; lb.used = 0; lb.size = 16 * BUF_SIZE;
+    lb.buf = (char *) malloc(lb.size);
+    if(!lb.buf)
 	error(_("cannot allocate buffer in readLines"));
     nn = (n < 0) ? 1000 : n; /* initially allocate space for 1000 lines */
     nnn = (n < 0) ? R_XLEN_T_MAX : n;
     PROTECT(ans = allocVector(STRSXP, nn));
     for(nread = 0; nread < nnn; nread++) {
+	if(lb.n == LINE_BATCH)
+	    linebatch_flush(&lb, ans, nread - lb.n, oenc);
 	if(nread >= nn) {
+	    linebatch_flush(&lb, ans, nread - lb.n, oenc);
 	    double dnn = 2.* nn;
 	    if (dnn > R_XLEN_T_MAX) error("too many items");
 	    ans2 = allocVector(STRSXP, 2*nn);
@@ -3964,38 +4180,39 @@ SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
 	    PROTECT(ans = ans2);
 	}
 	nbuf = 0;
+	if(lb.used == lb.size) linebatch_grow(&lb);
 	while((c = Rconn_fgetc(con)) != R_EOF) {
-	    if(nbuf == buf_size-1) {  /* need space for the terminator */
-		buf_size *= 2;
-		char *tmp = (char *) realloc(buf, buf_size);
-		if(!buf) {
-		    free(buf);
-		    error(_("cannot allocate buffer in readLines"));
-		} else buf = tmp;
-	    }
+	    /* need space for the terminator */
+	    if(lb.used + nbuf == lb.size - 1) linebatch_grow(&lb);
 	    if(skipNul && c == '\0') continue;
 	    if(c != '\n')
 		/* compiler-defined conversion behavior */
-		buf[nbuf++] = (char) c;
+		lb.buf[lb.used + nbuf++] = (char) c;
 	    else
 		break;
 	}
+	buf = lb.buf + lb.used;
 	buf[nbuf] = '\0';
 	/* Remove UTF-8 BOM */
-	const char *qbuf = buf;
+	size_t skip = 0;
 	// avoid valgrind warning if < 3 bytes
 	if (nread == 0 && utf8locale && strlen(buf) >= 3 &&
-	    !memcmp(buf, "\xef\xbb\xbf", 3)) qbuf = buf + 3;
-	SET_STRING_ELT(ans, nread, mkCharCE(qbuf, oenc));
+	    !memcmp(buf, "\xef\xbb\xbf", 3)) skip = 3;
+	linebatch_add(&lb, skip, nbuf);
 	if (warn && strlen(buf) < nbuf)
 	    warning(_("line %d appears to contain an embedded nul"), nread + 1);
-	if(c == R_EOF) goto no_more_lines;
+	if(c == R_EOF) {
+	    linebatch_flush(&lb, ans, nread + 1 - lb.n, oenc);
+	    goto no_more_lines;
+	}
     }
+    linebatch_flush(&lb, ans, nread - lb.n, oenc);
+    free(lb.buf);
     if(!wasopen) {endcontext(&cntxt); con->close(con);}
     UNPROTECT(1);
-    free(buf);
     return ans;
 no_more_lines:
+    /* the flush leaves the incomplete last line in buf */
     if(!wasopen) {endcontext(&cntxt); con->close(con);}
     if(nbuf > 0) { /* incomplete last line */
 	if(con->text && !con->blocking &&
@@ -4010,7 +4227,7 @@ no_more_lines:
 			con->description);
 	}
     }
-    free(buf);
+    free(lb.buf);
     if(nread < nnn && !ok)
 	error(_("too few lines read in readLines"));
     PROTECT(ans2 = allocVector(STRSXP, nread));
@@ -5552,13 +5769,14 @@ SEXP attribute_hidden do_url(SEXP call, SEXP op, SEXP args, SEXP env)
 			con = newfile(url, ienc, strlen(open) ? open : "r", raw);
 			break;
 		    case 0:
-			con = newgzfile(url, strlen(open) ? open : "rt", compress);
+			con = newgzfile(url, strlen(open) ? open : "rt", compress, 1);
 			break;
 		    case 1:
 			con = newbzfile(url, strlen(open) ? open : "rt", compress);
 			break;
 		    case 2:
-			con = newxzfile(url, strlen(open) ? open : "rt", subtype, compress);
+			con = newxzfile(url, strlen(open) ? open : "rt", subtype,
+					compress, 1);
 			break;
 		    }
 		} else
@@ -662,6 +662,41 @@ static SEXP R_HashProfile(SEXP table)
 
 static SEXP R_GlobalCache, R_GlobalCachePreserve;
 #endif
+
+/* Lookups of variables and functions that reach a namespace from its
+   own frames (or from the frames of closures defined in it) search
+   the namespace, its imports and the base namespace before going on
+   to R_GlobalEnv.  Once a namespace and its imports are locked,
+   bindings can no longer be added to or removed from their frames, so
+   where in that chain a symbol is found cannot change, and the
+   binding cell can be cached.  Namespaces are marked when they are
+   locked.  The cache is a direct-mapped table keyed by (namespace,
+   symbol, whether a function is wanted).  A cached location in the
+   base namespace is the symbol itself, and is checked to still have a
+   value when used.  For functions the value found is checked to still
+   be one, and a lookup that skipped a binding that was not a function
+   is not cached.  Changing the enclosure of an environment increments
+   R_NamespaceCacheEpoch, which invalidates all entries.  The cache can
+   be disabled by setting _R_NS_LOOKUP_CACHE_ to a false value. */
+
+#define NSCACHE_FRAME_MASK (1<<13)
+#define IS_NSCACHE_FRAME(e) (ENVFLAGS(e) & NSCACHE_FRAME_MASK)
+#define MARK_AS_NSCACHE_FRAME(e) \
+  SET_ENVFLAGS(e, ENVFLAGS(e) | NSCACHE_FRAME_MASK)
+
+#define NSCACHE_SIZE 4096
+
+typedef struct {
+    SEXP rho, symbol, loc;
+    unsigned int epoch;
+    int fun;
+} R_NSCacheEntry;
+
+static R_NSCacheEntry R_NSCache[NSCACHE_SIZE];
+static SEXP R_NSCacheProtect = NULL;	/* keeps rho and loc alive */
+static int R_NSCacheEnabled = -1;
+static double R_NSCacheHits = 0, R_NSCacheMisses = 0;
+
 static SEXP R_BaseNamespaceName;
 static SEXP R_NamespaceSymbol;
 
@@ -976,6 +1011,7 @@ Rboolean R_GetVarLocMISSING(R_varloc_t vl)
 attribute_hidden
 void R_SetVarLocValue(R_varloc_t vl, SEXP value)
 {
+    R_FlushS3MethodCache(TAG(vl.cell));
     SET_BINDING_VALUE(vl.cell, value);
 }
 
@@ -1215,6 +1251,120 @@ static R_INLINE SEXP findGlobalVar(SEXP symbol)
 }
 #endif
 
+static R_INLINE int NSCacheIndex(SEXP rho, SEXP symbol, int fun)
+{
+    uintptr_t h = ((uintptr_t) rho >> 4) ^ ((uintptr_t) symbol >> 3);
+    return (int) ((((uint64_t) h * 0x9E3779B97F4A7C15ULL) >> 52) ^ fun)
+	& (NSCACHE_SIZE - 1);
+}
+
+/* The value of a function binding at 'loc', or R_UnboundValue if it
+   does not (yet) hold a function. Promises are not forced. */
+static R_INLINE SEXP NSCacheFunValue(SEXP loc)
+{
+    SEXP vl;
+    if (TYPEOF(loc) == SYMSXP)
+	vl = SYMVALUE(loc);
+    else if (BNDCELL_TAG(loc))
+	return R_UnboundValue;
+    else
+	vl = CAR(loc);
+    if (TYPEOF(vl) == PROMSXP)
+	vl = PRVALUE(vl);
+    if (TYPEOF(vl) == CLOSXP || TYPEOF(vl) == BUILTINSXP ||
+	TYPEOF(vl) == SPECIALSXP)
+	return vl;
+    else
+	return R_UnboundValue;
+}
+
+/* Look up 'symbol' in the namespace 'rho', its imports and the base
+   namespace using the cache.  Returns the binding location, which for
+   a function lookup holds a function; R_NilValue if the symbol is not
+   bound there, so the search should continue at R_GlobalEnv; or
+   R_UnboundValue if the search has to be done without the cache. */
+static SEXP findNSCacheLoc(SEXP symbol, SEXP rho, int fun)
+{
+    if (R_NSCacheEnabled <= 0) {
+	if (R_NSCacheEnabled == 0)
+	    return R_UnboundValue;
+	char *p = getenv("_R_NS_LOOKUP_CACHE_");
+	R_NSCacheEnabled = (p != NULL && StringFalse(p)) ? 0 : 1;
+	if (R_NSCacheEnabled == 0)
+	    return R_UnboundValue;
+    }
+
+    int i = NSCacheIndex(rho, symbol, fun);
+    R_NSCacheEntry *ce = R_NSCache + i;
+    if (ce->rho == rho && ce->symbol == symbol && ce->fun == fun &&
+	ce->epoch == R_NamespaceCacheEpoch) {
+	SEXP loc = ce->loc;
+	if (fun ? NSCacheFunValue(loc) != R_UnboundValue :
+	    (TYPEOF(loc) != SYMSXP || SYMVALUE(loc) != R_UnboundValue)) {
+	    R_NSCacheHits++;
+	    return loc;
+	}
+    }
+    R_NSCacheMisses++;
+
+    /* the frames up to the base namespace must all be locked */
+    SEXP e;
+    for (e = rho; e != R_BaseNamespace; e = ENCLOS(e))
+	if (e == R_GlobalEnv || e == R_EmptyEnv || e == R_BaseEnv ||
+	    ! FRAME_IS_LOCKED(e) || IS_USER_DATABASE(e))
+	    return R_UnboundValue;
+
+    SEXP loc = R_NilValue;
+    for (e = rho; ; e = ENCLOS(e)) {
+	loc = findVarLocInFrame(e, symbol, NULL);
+	if (loc != R_NilValue) {
+	    if (IS_ACTIVE_BINDING(loc))
+		return R_UnboundValue;
+	    if (! fun || NSCacheFunValue(loc) != R_UnboundValue)
+		break;
+	    /* a promise may yet give a function, and a binding that
+	       is not a function may be changed to one */
+	    return R_UnboundValue;
+	}
+	if (e == R_BaseNamespace)
+	    return R_NilValue;
+    }
+
+    if (R_NSCacheProtect == NULL) {
+	R_NSCacheProtect = allocVector(VECSXP, 2 * NSCACHE_SIZE);
+	R_PreserveObject(R_NSCacheProtect);
+    }
+    ce->rho = rho;
+    ce->symbol = symbol;
+    ce->loc = loc;
+    ce->fun = fun;
+    ce->epoch = R_NamespaceCacheEpoch;
+    SET_VECTOR_ELT(R_NSCacheProtect, 2 * i, rho);
+    SET_VECTOR_ELT(R_NSCacheProtect, 2 * i + 1, loc);
+    return loc;
+}
+
+/* .Internal(nsLookupCacheStats(reset)) */
+SEXP attribute_hidden do_nsLookupCacheStats(SEXP call, SEXP op, SEXP args,
+					   SEXP rho)
+{
+    checkArity(op, args);
+    int reset = asLogical(CAR(args));
+    if (reset == NA_LOGICAL)
+	error(_("invalid '%s' argument"), "reset");
+    SEXP ans = PROTECT(allocVector(REALSXP, 2));
+    SEXP nms = PROTECT(allocVector(STRSXP, 2));
+    REAL(ans)[0] = R_NSCacheHits;
+    REAL(ans)[1] = R_NSCacheMisses;
+    SET_STRING_ELT(nms, 0, mkChar("hits"));
+    SET_STRING_ELT(nms, 1, mkChar("misses"));
+    setAttrib(ans, R_NamesSymbol, nms);
+    if (reset)
+	R_NSCacheHits = R_NSCacheMisses = 0;
+    UNPROTECT(2);
+    return ans;
+}
+
 SEXP findVar(SEXP symbol, SEXP rho)
 {
     SEXP vl;
@@ -1230,6 +1380,17 @@ SEXP findVar(SEXP symbol, SEXP rho)
        will also handle all frames if rho is a global frame other than
        R_GlobalEnv */
     while (rho != R_GlobalEnv && rho != R_EmptyEnv) {
+	if (IS_NSCACHE_FRAME(rho)) {
+	    vl = findNSCacheLoc(symbol, rho, FALSE);
+	    if (vl != R_UnboundValue) {
+		if (vl == R_NilValue) {
+		    rho = R_GlobalEnv;
+		    break;
+		}
+		return TYPEOF(vl) == SYMSXP ? SYMBOL_BINDING_VALUE(vl) :
+		    BINDING_VALUE(vl);
+	    }
+	}
 	vl = findVarInFrame3(rho, symbol, TRUE /* get rather than exists */);
 	if (vl != R_UnboundValue) return (vl);
 	rho = ENCLOS(rho);
@@ -1263,6 +1424,14 @@ static SEXP findVarLoc(SEXP symbol, SEXP rho)
        will also handle all frames if rho is a global frame other than
        R_GlobalEnv */
     while (rho != R_GlobalEnv && rho != R_EmptyEnv) {
+	if (IS_NSCACHE_FRAME(rho)) {
+	    vl = findNSCacheLoc(symbol, rho, FALSE);
+	    if (vl != R_UnboundValue) {
+		if (vl != R_NilValue) return vl;
+		rho = R_GlobalEnv;
+		break;
+	    }
+	}
 	vl = findVarLocInFrame(rho, symbol, NULL);
 	if (vl != R_NilValue) return vl;
 	rho = ENCLOS(rho);
@@ -1537,6 +1706,14 @@ SEXP findFun3(SEXP symbol, SEXP rho, SEXP call)
     }
 
     while (rho != R_EmptyEnv) {
+	if (IS_NSCACHE_FRAME(rho)) {
+	    vl = findNSCacheLoc(symbol, rho, TRUE);
+	    if (vl != R_UnboundValue) {
+		if (vl != R_NilValue)
+		    return NSCacheFunValue(vl);
+		rho = R_GlobalEnv;
+	    }
+	}
 	/* This is not really right.  Any variable can mask a function */
 #ifdef USE_GLOBAL_CACHE
 	if (rho == R_GlobalEnv)
@@ -1607,6 +1784,8 @@ void defineVar(SEXP symbol, SEXP value, SEXP rho)
     if (rho == R_EmptyEnv)
 	error(_("cannot assign values in the empty environment"));
 
+    R_FlushS3MethodCache(symbol);
+
     if(IS_USER_DATABASE(rho)) {
 	R_ObjectTable *table;
 	table = (R_ObjectTable *) R_ExternalPtrAddr(HASHTAB(rho));
@@ -1736,6 +1915,8 @@ static SEXP setVarInFrame(SEXP rho, SEXP symbol, SEXP value)
     if (rho == R_GlobalEnv) R_DirtyImage = 1;
     if (rho == R_EmptyEnv) return R_NilValue;
 
+    R_FlushS3MethodCache(symbol);
+
     if(IS_USER_DATABASE(rho)) {
 	/* FIXME: This does not behave as described */
 	R_ObjectTable *table;
@@ -1831,6 +2012,7 @@ void gsetVar(SEXP symbol, SEXP value, SEXP rho)
 #ifdef USE_GLOBAL_CACHE
     R_FlushGlobalCache(symbol);
 #endif
+    R_FlushS3MethodCache(symbol);
     SET_SYMBOL_BINDING_VALUE(symbol, value);
 }
 
@@ -1933,6 +2115,8 @@ static int RemoveVariable(SEXP name, int hashcode, SEXP env)
     if (FRAME_IS_LOCKED(env))
 	error(_("cannot remove bindings from a locked environment"));
 
+    R_FlushS3MethodCache(name);
+
     if(IS_USER_DATABASE(env)) {
 	R_ObjectTable *table;
 	table = (R_ObjectTable *) R_ExternalPtrAddr(HASHTAB(env));
@@ -2559,6 +2743,7 @@ SEXP attribute_hidden do_attach(SEXP call, SEXP op, SEXP args, SEXP env)
 	MARK_AS_GLOBAL_FRAME(s);
 #endif
     }
+    R_S3MethodCacheEpoch++; /* the search path has changed */
 
     UNPROTECT(1); /* s */
     return s;
@@ -2617,6 +2802,7 @@ SEXP attribute_hidden do_detach(SEXP call, SEXP op, SEXP args, SEXP env)
 	MARK_AS_LOCAL_FRAME(s); /* was _GLOBAL_ prior to 2.4.0 */
     }
 #endif
+    R_S3MethodCacheEpoch++; /* the search path has changed */
     UNPROTECT(1);
     return s;
 }
@@ -3310,6 +3496,8 @@ void R_LockEnvironment(SEXP env, Rboolean bindings)
 	}
     }
     LOCK_FRAME(env);
+    if (R_IsNamespaceEnv(env))
+	MARK_AS_NSCACHE_FRAME(env);
 }
 
 Rboolean R_EnvironmentIsLocked(SEXP env)
@@ -3392,6 +3580,7 @@ void R_MakeActiveBinding(SEXP sym, SEXP fun, SEXP env)
     if (TYPEOF(env) != ENVSXP &&
 	TYPEOF((env = simple_as_environment(env))) != ENVSXP)
 	error(_("not an environment"));
+    R_FlushS3MethodCache(sym);
     if (env == R_BaseEnv || env == R_BaseNamespace) {
 	if (SYMVALUE(sym) != R_UnboundValue && ! IS_ACTIVE_BINDING(sym))
 	    error(_("symbol already has a regular binding"));
@@ -3590,6 +3779,7 @@ SEXP attribute_hidden do_mkUnbound(SEXP call, SEXP op, SEXP args, SEXP rho)
 #ifdef USE_GLOBAL_CACHE
     R_FlushGlobalCache(sym);
 #endif
+    R_FlushS3MethodCache(sym);
     return R_NilValue;
 }
 
@@ -4119,47 +4309,17 @@ static void R_StringHash_resize(unsigned int newsize)
    the global CHARSXP cache, R_StringHash, it is returned.  Otherwise,
    a new CHARSXP is created, added to the cache and then returned. */
 
-SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
+/* Find or add the CHARSXP for 'name' given its full hash value, with
+   'enc' already normalized for ASCII strings.  If 'resize' is false,
+   the caller is responsible for resizing the table. */
+static SEXP mkCharLenCE_hashed(const char *name, int len, cetype_t enc,
+			       Rboolean is_ascii, unsigned int hash,
+			       Rboolean resize)
 {
     SEXP cval, chain;
     unsigned int hashcode;
     int need_enc;
-    Rboolean embedNul = FALSE, is_ascii = TRUE;
 
-    switch(enc){
-    case CE_NATIVE:
-    case CE_UTF8:
-    case CE_LATIN1:
-    case CE_BYTES:
-    case CE_SYMBOL:
-    case CE_ANY:
-	break;
-    default:
-	error(_("unknown encoding: %d"), enc);
-    }
-    for (int slen = 0; slen < len; slen++) {
-	if ((unsigned int) name[slen] > 127) is_ascii = FALSE;
-	if (!name[slen]) embedNul = TRUE;
-    }
-    if (embedNul) {
-	SEXP c;
-	/* This is tricky: we want to make a reasonable job of
-	   representing this string, and EncodeString() is the most
-	   comprehensive */
-	c = allocCharsxp(len);
-	memcpy(CHAR_RW(c), name, len);
-	switch(enc) {
-	case CE_UTF8: SET_UTF8(c); break;
-	case CE_LATIN1: SET_LATIN1(c); break;
-	case CE_BYTES: SET_BYTES(c); break;
-	default: break;
-	}
-	if (is_ascii) SET_ASCII(c);
-	error(_("embedded nul in string: '%s'"),
-	      EncodeString(c, 0, 0, Rprt_adj_none));
-    }
-
-    if (enc && is_ascii) enc = CE_NATIVE;
     switch(enc) {
     case CE_UTF8: need_enc = UTF8_MASK; break;
     case CE_LATIN1: need_enc = LATIN1_MASK; break;
@@ -4167,7 +4327,7 @@ SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
     default: need_enc = 0;
     }
 
-    hashcode = char_hash(name, len) & char_hash_mask;
+    hashcode = hash & char_hash_mask;
 
     /* Search for a cached value */
     cval = R_NilValue;
@@ -4216,7 +4376,7 @@ SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
 	   Maximum possible power of two is 2^30 for a VECSXP.
 	   FIXME: this has changed with long vectors.
 	*/
-	if (R_HashSizeCheck(R_StringHash)
+	if (resize && R_HashSizeCheck(R_StringHash)
 	    && char_hash_size < 1073741824 /* 2^30 */)
 	    R_StringHash_resize(char_hash_size * 2);
 
@@ -4225,6 +4385,111 @@ SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
     return cval;
 }
 
+SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
+{
+    Rboolean embedNul = FALSE, is_ascii = TRUE;
+
+    switch(enc){
+    case CE_NATIVE:
+    case CE_UTF8:
+    case CE_LATIN1:
+    case CE_BYTES:
+    case CE_SYMBOL:
+    case CE_ANY:
+	break;
+    default:
+	error(_("unknown encoding: %d"), enc);
+    }
+    for (int slen = 0; slen < len; slen++) {
+	if ((unsigned int) name[slen] > 127) is_ascii = FALSE;
+	if (!name[slen]) embedNul = TRUE;
+    }
+    if (embedNul) {
+	SEXP c;
+	/* This is tricky: we want to make a reasonable job of
+	   representing this string, and EncodeString() is the most
+	   comprehensive */
+	c = allocCharsxp(len);
+	memcpy(CHAR_RW(c), name, len);
+	switch(enc) {
+	case CE_UTF8: SET_UTF8(c); break;
+	case CE_LATIN1: SET_LATIN1(c); break;
+	case CE_BYTES: SET_BYTES(c); break;
+	default: break;
+	}
+	if (is_ascii) SET_ASCII(c);
+	error(_("embedded nul in string: '%s'"),
+	      EncodeString(c, 0, 0, Rprt_adj_none));
+    }
+
+    if (enc && is_ascii) enc = CE_NATIVE;
+    return mkCharLenCE_hashed(name, len, enc, is_ascii,
+			      char_hash(name, len), TRUE);
+}
+
+/* R_mkCharLenCEs - set x[offset + i] to the CHARSXP for strs[i] for
+   i < n, as mkCharLenCE would, for readers creating many strings.
+   The strings are first scanned and hashed.  The table is then grown,
+   if needed, to take the batch before the strings are looked up and
+   added in one pass.  Strings with embedded nuls or invalid encodings
+   are passed to mkCharLenCE for its error. */
+void attribute_hidden
+R_mkCharLenCEs(SEXP x, R_xlen_t offset, const R_CharSpec *strs, int n)
+{
+    if (n <= 0) return;
+    const void *vmax = vmaxget();
+    unsigned int *hash = (unsigned int *) R_alloc(n, sizeof(unsigned int));
+    char *flags = R_alloc(n, sizeof(char)); /* 1: ascii, 2: needs checks */
+
+    for (int i = 0; i < n; i++) {
+	const char *name = strs[i].name;
+	int len = strs[i].len;
+	char f = 1;
+	unsigned int h = 5381;
+	for (int j = 0; j < len; j++) {
+	    if ((unsigned int) name[j] > 127) f &= ~1;
+	    if (!name[j]) f |= 2;
+	    h = ((h << 5) + h) + name[j]; /* as char_hash */
+	}
+	switch(strs[i].enc) {
+	case CE_NATIVE: case CE_UTF8: case CE_LATIN1:
+	case CE_BYTES: case CE_SYMBOL: case CE_ANY:
+	    break;
+	default:
+	    f |= 2;
+	}
+	hash[i] = h;
+	flags[i] = f;
+    }
+
+    /* Grow the table so that it still has room after adding the batch
+       if all the strings are new.  Duplicates in large batches of
+       short strings are common, so allow at most doubling. */
+    unsigned int pri = HASHPRI(R_StringHash);
+    if (pri + (unsigned int) n > 0.85 * char_hash_size &&
+	char_hash_size < 1073741824 /* 2^30 */)
+	R_StringHash_resize(char_hash_size * 2);
+
+    for (int i = 0; i < n; i++) {
+	SEXP c;
+	if (flags[i] & 2)
+	    c = mkCharLenCE(strs[i].name, strs[i].len, strs[i].enc);
+	else {
+	    cetype_t enc = strs[i].enc;
+	    Rboolean is_ascii = flags[i] & 1;
+	    if (enc && is_ascii) enc = CE_NATIVE;
+	    c = mkCharLenCE_hashed(strs[i].name, strs[i].len, enc, is_ascii,
+				   hash[i], FALSE);
+	}
+	SET_STRING_ELT(x, offset + i, c);
+    }
+
+    while (R_HashSizeCheck(R_StringHash)
+	   && char_hash_size < 1073741824 /* 2^30 */)
+	R_StringHash_resize(char_hash_size * 2);
+    vmaxset(vmax);
+}
+
 
 #ifdef DEBUG_SHOW_CHARSXP_CACHE
 /* Call this from gdb with
@@ -30,8 +30,13 @@
 #include <Fileio.h>
 #include <R_ext/Print.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for getpid */
+#endif
+
 
 static SEXP bcEval(SEXP, SEXP, Rboolean);
+static SEXP promiseArgs1(SEXP, SEXP, Rboolean);
 
 /* BC_PROFILING needs to be enabled at build time. It is not enabled
    by default as enabling it disables the more efficient threaded code
@@ -105,6 +110,11 @@ static size_t R_Srcfile_bufcount;                  /* how big is the array above
 static SEXP R_Srcfiles_buffer = NULL;              /* a big RAWSXP to use as a buffer for filenames and pointers to them */
 static int R_Profiling_Error;		   /* record errors here */
 static int R_Filter_Callframes = 0;	      	   /* whether to record only the trailing branch of call trees */
+static int R_BC_Profiling = 0;			   /* whether to sample byte code instructions */
+
+static void bcprof_sample(void);
+static void bcprof_start(void);
+static void bcprof_write(FILE *);
 
 #ifdef Win32
 HANDLE MainThread;
@@ -249,6 +259,9 @@ static void doprof(int sig)  /* sig is ignored in Windows */
     if (R_Line_Profiling)
 	lineprof(buf, R_getCurrentSrcref());
 
+    if (R_BC_Profiling)
+	bcprof_sample();
+
     for (RCNTXT *cptr = R_GlobalContext;
 	 cptr != NULL;
 	 cptr = findProfContext(cptr)) {
@@ -382,7 +395,12 @@ static void R_EndProfiling(void)
     signal(SIGPROF, doprof_null);
 
 #endif /* not Win32 */
-    if(R_ProfileOutfile) fclose(R_ProfileOutfile);
+    if(R_ProfileOutfile) {
+	if (R_BC_Profiling)
+	    bcprof_write(R_ProfileOutfile);
+	fclose(R_ProfileOutfile);
+    }
+    R_BC_Profiling = 0;
     R_ProfileOutfile = NULL;
     R_Profiling = 0;
     if (R_Srcfiles_buffer) {
@@ -397,7 +415,7 @@ static void R_EndProfiling(void)
 static void R_InitProfiling(SEXP filename, int append, double dinterval,
 			    int mem_profiling, int gc_profiling,
 			    int line_profiling, int filter_callframes,
-			    int numfiles, int bufsize)
+			    int numfiles, int bufsize, int bc_profiling)
 {
 #ifndef Win32
     struct itimerval itv;
@@ -419,6 +437,8 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
 	fprintf(R_ProfileOutfile, "GC profiling: ");
     if(line_profiling)
 	fprintf(R_ProfileOutfile, "line profiling: ");
+    if(bc_profiling)
+	fprintf(R_ProfileOutfile, "bytecode profiling: ");
     fprintf(R_ProfileOutfile, "sample.interval=%d\n", interval);
 
     R_Mem_Profiling=mem_profiling;
@@ -429,6 +449,9 @@ static void R_InitProfiling(SEXP filename, int append, double dinterval,
     R_Line_Profiling = line_profiling;
     R_GC_Profiling = gc_profiling;
     R_Filter_Callframes = filter_callframes;
+    if (bc_profiling)
+	bcprof_start();
+    R_BC_Profiling = bc_profiling;
 
     if (line_profiling) {
 	/* Allocate a big RAW vector to use as a buffer.  The first len1 bytes are an array of pointers
@@ -474,7 +497,7 @@ SEXP do_Rprof(SEXP args)
 {
     SEXP filename;
     int append_mode, mem_profiling, gc_profiling, line_profiling,
-	filter_callframes;
+	filter_callframes, bc_profiling;
     double dinterval;
     int numfiles, bufsize;
 
@@ -496,15 +519,18 @@ SEXP do_Rprof(SEXP args)
     numfiles = asInteger(CAR(args));	      args = CDR(args);
     if (numfiles < 0)
 	error(_("invalid '%s' argument"), "numfiles");
-    bufsize = asInteger(CAR(args));
+    bufsize = asInteger(CAR(args));	      args = CDR(args);
     if (bufsize < 0)
 	error(_("invalid '%s' argument"), "bufsize");
+    bc_profiling = asLogical(CAR(args));
+    if (bc_profiling == NA_LOGICAL)
+	error(_("invalid '%s' argument"), "bytecode.profiling");
 
     filename = STRING_ELT(filename, 0);
     if (LENGTH(filename))
 	R_InitProfiling(filename, append_mode, dinterval, mem_profiling,
 			gc_profiling, line_profiling, filter_callframes,
-			numfiles, bufsize);
+			numfiles, bufsize, bc_profiling);
     else
 	R_EndProfiling();
     return R_NilValue;
@@ -845,7 +871,7 @@ SEXP eval(SEXP e, SEXP rho)
 	    vmaxset(vmax);
 	}
 	else if (TYPEOF(op) == CLOSXP) {
-	    SEXP pargs = promiseArgs(CDR(e), rho);
+	    SEXP pargs = promiseArgs1(CDR(e), rho, TRUE);
 	    PROTECT(pargs);
 	    tmp = applyClosure(e, op, pargs, rho, R_NilValue);
 #ifdef ADJUST_ENVIR_REFCNTS
@@ -1020,6 +1046,7 @@ static SEXP R_RepeatSymbol = NULL;
 #define JIT_CACHE_SIZE 1024
 static SEXP JIT_cache = NULL;
 static R_exprhash_t JIT_cache_hashes[JIT_CACHE_SIZE];
+static char *jit_disk_dir = NULL; /* persistent cache, see below */
 
 /**** allow MIN_JIT_SCORE, or both, to be changed by environment variables? */
 static int MIN_JIT_SCORE = 50;
@@ -1087,6 +1114,13 @@ void attribute_hidden R_init_jit_enabled(void)
     R_RepeatSymbol = install("repeat");
 
     R_PreserveObject(JIT_cache = allocVector(VECSXP, JIT_CACHE_SIZE));
+
+    char *dir = getenv("R_JIT_CACHE_DIR");
+    if (dir != NULL && dir[0]) {
+	const char *p = R_ExpandFileName(dir);
+	if (R_FileExists(p) && (jit_disk_dir = malloc(strlen(p) + 1)))
+	    strcpy(jit_disk_dir, p);
+    }
 }
 
 static int JIT_score(SEXP e)
@@ -1422,6 +1456,206 @@ SEXP attribute_hidden R_cmpfun1(SEXP fun)
     return val;
 }
 
+/* Persistent JIT cache.
+
+   If the environment variable R_JIT_CACHE_DIR names a directory, code
+   compiled by the JIT for closures in namespaces is also saved there,
+   and looked for there before compiling, so later sessions can skip
+   the compilation.  A file is named by a 64-bit hash of the
+   serialization of its key: the expression, the names of the local
+   variables of the compilation environment (as for the in-memory
+   cache), the name and version of the namespace, the compiler's
+   optimization level and the byte code version; the serialization
+   header adds the R version.  Code read from a file is only used if its
+   expression is identical to the one to be compiled and the
+   environments match as for the in-memory cache, so a hash collision
+   just means compiling.
+
+   Code whose top level environment is the global environment is not
+   cached: how it is compiled depends on which base functions are
+   shadowed by variables in the global environment and on the search
+   path, which the key does not capture.  Nor are expressions with
+   source references, or referring to environments other than
+   namespaces and the global and base environments.  Files are written
+   to a temporary name and then renamed, so concurrent sessions can
+   share a directory. */
+static Rboolean jit_disk_unsafe;
+
+/* forward declaration */
+static int bcVersion(void);
+
+static SEXP jit_disk_hook(SEXP s, SEXP data)
+{
+    jit_disk_unsafe = TRUE;
+    return mkString("");
+}
+
+static void jit_disk_hash_char(R_outpstream_t stream, int c)
+{
+    uint64_t *h = stream->data;
+    *h = (*h ^ (unsigned char) c) * 1099511628211ULL; /* FNV-1a */
+}
+
+static void jit_disk_hash_bytes(R_outpstream_t stream, void *buf, int length)
+{
+    uint64_t *h = stream->data;
+    unsigned char *p = buf;
+    for (int i = 0; i < length; i++)
+	*h = (*h ^ p[i]) * 1099511628211ULL;
+}
+
+static SEXP jit_disk_topenv_desc(SEXP top)
+{
+    if (R_IsNamespaceEnv(top) && top != R_BaseNamespace)
+	return R_NamespaceEnvSpec(top);
+    else return R_NilValue;
+}
+
+static int jit_disk_optimize(void)
+{
+    SEXP fcall, call;
+    PROTECT(fcall = lang3(R_TripleColonSymbol, install("compiler"),
+			  install("getCompilerOption")));
+    PROTECT(call = lang2(fcall, mkString("optimize")));
+    int val = asInteger(eval(call, R_GlobalEnv));
+    UNPROTECT(2); /* fcall, call */
+    return val;
+}
+
+/* Computes the name of the cache file for expr compiled in an
+   environment with the local variables named in locals below top;
+   returns FALSE if the expression is not to be cached. */
+static Rboolean jit_disk_path(SEXP expr, SEXP locals, SEXP top, char *path)
+{
+    SEXP desc = PROTECT(jit_disk_topenv_desc(top));
+    if (desc == R_NilValue) {
+	UNPROTECT(1); /* desc */
+	return FALSE;
+    }
+    SEXP key = PROTECT(allocVector(VECSXP, 4));
+    SET_VECTOR_ELT(key, 0, expr);
+    SET_VECTOR_ELT(key, 1, locals);
+    SET_VECTOR_ELT(key, 2, desc);
+    SET_VECTOR_ELT(key, 3, allocVector(INTSXP, 2));
+    INTEGER(VECTOR_ELT(key, 3))[0] = jit_disk_optimize();
+    INTEGER(VECTOR_ELT(key, 3))[1] = bcVersion();
+
+    struct R_outpstream_st out;
+    uint64_t h = 14695981039346656037ULL;
+    jit_disk_unsafe = FALSE;
+    R_InitOutPStream(&out, (R_pstream_data_t) &h, R_pstream_xdr_format, 3,
+		     jit_disk_hash_char, jit_disk_hash_bytes,
+		     jit_disk_hook, R_NilValue);
+    R_Serialize(key, &out);
+    UNPROTECT(2); /* desc, key */
+    if (jit_disk_unsafe)
+	return FALSE;
+
+    snprintf(path, PATH_MAX, "%s/%016llx.rjc", jit_disk_dir,
+	     (unsigned long long) h);
+    return TRUE;
+}
+
+/* The names of the local variables of the compilation environment as
+   computed by make_cached_cmpenv */
+static SEXP jit_disk_locals(SEXP cmpenv)
+{
+    int n = 0;
+    if (cmpenv == topenv(R_NilValue, cmpenv))
+	return allocVector(STRSXP, 0);
+    for (SEXP frame = FRAME(cmpenv); frame != R_NilValue; frame = CDR(frame))
+	n++;
+    SEXP locals = PROTECT(allocVector(STRSXP, n));
+    n = 0;
+    for (SEXP frame = FRAME(cmpenv); frame != R_NilValue; frame = CDR(frame))
+	SET_STRING_ELT(locals, n++, PRINTNAME(TAG(frame)));
+    UNPROTECT(1); /* locals */
+    return locals;
+}
+
+typedef struct {
+    FILE *fp;
+    SEXP val;
+} jit_disk_io_data;
+
+static SEXP jit_disk_read1(void *data)
+{
+    jit_disk_io_data *d = data;
+    struct R_inpstream_st in;
+    R_InitFileInPStream(&in, d->fp, R_pstream_any_format, NULL, R_NilValue);
+    return R_Unserialize(&in);
+}
+
+static SEXP jit_disk_write1(void *data)
+{
+    jit_disk_io_data *d = data;
+    struct R_outpstream_st out;
+    R_InitFileOutPStream(&out, d->fp, R_pstream_xdr_format, 3,
+			 jit_disk_hook, R_NilValue);
+    R_Serialize(d->val, &out);
+    return R_NilValue;
+}
+
+static SEXP jit_disk_error(SEXP cond, void *data)
+{
+    return NULL;
+}
+
+/* Returns code compiled from expr saved under path, or R_NilValue */
+static SEXP jit_disk_read(const char *path, SEXP expr)
+{
+    FILE *fp = R_fopen(path, "rb");
+    if (fp == NULL)
+	return R_NilValue;
+    jit_disk_io_data d = { fp, R_NilValue };
+    SEXP code = R_tryCatchError(jit_disk_read1, &d, jit_disk_error, NULL);
+    fclose(fp);
+    if (code == NULL || TYPEOF(code) != BCODESXP || !R_BCVersionOK(code))
+	return R_NilValue;
+    PROTECT(code);
+    Rboolean ok = jit_expr_match(bytecodeExpr(code), expr);
+    UNPROTECT(1); /* code */
+    return ok ? code : R_NilValue;
+}
+
+static void jit_disk_write(const char *path, SEXP code)
+{
+    char tmp[PATH_MAX];
+    snprintf(tmp, PATH_MAX, "%s.%d", path, (int) getpid());
+    FILE *fp = R_fopen(tmp, "wb");
+    if (fp == NULL)
+	return;
+    jit_disk_io_data d = { fp, code };
+    jit_disk_unsafe = FALSE;
+    SEXP res = R_tryCatchError(jit_disk_write1, &d, jit_disk_error, NULL);
+    Rboolean ok = fclose(fp) == 0 && res != NULL && !jit_disk_unsafe;
+    if (!ok || rename(tmp, path) != 0)
+	unlink(tmp);
+}
+
+/* If code for fun is in the disk cache, installs it and returns TRUE;
+   otherwise, sets path to the file to save the code in, or to "" if
+   it is not to be cached. */
+static Rboolean jit_disk_load_fun(SEXP fun, char *path)
+{
+    path[0] = '\0';
+    if (getAttrib(fun, R_SrcrefSymbol) != R_NilValue)
+	return FALSE;
+    SEXP cmpenv = PROTECT(make_cached_cmpenv(fun));
+    SEXP locals = PROTECT(jit_disk_locals(cmpenv));
+    SEXP top = topenv(R_NilValue, cmpenv);
+    Rboolean found = FALSE;
+    if (jit_disk_path(BODY(fun), locals, top, path)) {
+	SEXP code = jit_disk_read(path, BODY(fun));
+	if (code != R_NilValue && jit_env_match(cmpenv, fun)) {
+	    SET_BODY(fun, code);
+	    found = TRUE;
+	}
+    }
+    UNPROTECT(2); /* cmpenv, locals */
+    return found;
+}
+
 /* fun is modified in-place when compiled */
 static void R_cmpfun(SEXP fun)
 {
@@ -1471,6 +1705,13 @@ static void R_cmpfun(SEXP fun)
 	PRINT_JIT_INFO;
     }
 
+    char path[PATH_MAX];
+    if (jit_disk_dir != NULL && jit_disk_load_fun(fun, path)) {
+	if (jit_strategy != STRATEGY_NO_CACHE)
+	    set_jit_cache_entry(hash, fun);
+	return;
+    }
+
     SEXP val = R_cmpfun1(fun);
 
     if (TYPEOF(BODY(val)) != BCODESXP)
@@ -1479,6 +1720,8 @@ static void R_cmpfun(SEXP fun)
 	if (jit_strategy != STRATEGY_NO_CACHE)
 	    set_jit_cache_entry(hash, val); /* val is protected by callee */
 	SET_BODY(fun, BODY(val));
+	if (jit_disk_dir != NULL && path[0])
+	    jit_disk_write(path, BODY(fun));
     }
 }
 
@@ -2261,6 +2504,7 @@ static R_INLINE Rboolean SET_BINDING_VALUE(SEXP loc, SEXP value) {
     if (loc != R_NilValue &&
 	! BINDING_IS_LOCKED(loc) && ! IS_ACTIVE_BINDING(loc)) {
 	if (BNDCELL_TAG(loc) || CAR(loc) != value) {
+	    R_FlushS3MethodCache(TAG(loc));
 	    SET_BNDCELL(loc, value);
 	    if (MISSING(loc))
 		SET_MISSING(loc, 0);
@@ -3159,12 +3403,22 @@ SEXP attribute_hidden evalListKeepMissing(SEXP el, SEXP rho)
 }
 
 
+/* Self-evaluating constants, as the parser produces for literals,
+   need no promise when passed to a closure: the byte code compiler
+   pushes them directly with PUSHCONSTARG, and substitute() and
+   missing() give the same results for them as for a promise. */
+#define IS_SELF_EVALUATING_CONST(x)					\
+    (TYPEOF(x) == NILSXP || (isVectorAtomic(x) && ATTRIB(x) == R_NilValue))
+
 /* Create a promise to evaluate each argument.	Although this is most */
 /* naturally attacked with a recursive algorithm, we use the iterative */
 /* form below because it is does not cause growth of the pointer */
 /* protection stack, and because it is a little more efficient. */
+/* If 'constok' is true, self-evaluating constants are passed as they */
+/* are; this is only for argument lists passed to closures, as many */
+/* internal callers expect every non-missing argument to be a promise. */
 
-SEXP attribute_hidden promiseArgs(SEXP el, SEXP rho)
+static SEXP promiseArgs1(SEXP el, SEXP rho, Rboolean constok)
 {
     SEXP ans, h, tail;
 
@@ -3191,6 +3445,10 @@ SEXP attribute_hidden promiseArgs(SEXP el, SEXP rho)
 		while (h != R_NilValue) {
 		    if (CAR(h) == R_MissingArg)
 		      SETCDR(tail, CONS(CAR(h), R_NilValue));
+		    else if (constok && IS_SELF_EVALUATING_CONST(CAR(h))) {
+			ENSURE_NAMEDMAX(CAR(h));
+			SETCDR(tail, CONS(CAR(h), R_NilValue));
+		    }
                     else
 		      SETCDR(tail, CONS(mkPROMISE(CAR(h), rho), R_NilValue));
 		    tail = CDR(tail);
@@ -3207,6 +3465,12 @@ SEXP attribute_hidden promiseArgs(SEXP el, SEXP rho)
 	    tail = CDR(tail);
 	    COPY_TAG(tail, el);
 	}
+	else if (constok && IS_SELF_EVALUATING_CONST(CAR(el))) {
+	    ENSURE_NAMEDMAX(CAR(el));
+	    SETCDR(tail, CONS(CAR(el), R_NilValue));
+	    tail = CDR(tail);
+	    COPY_TAG(tail, el);
+	}
 	else {
 	    SETCDR(tail, CONS(mkPROMISE(CAR(el), rho), R_NilValue));
 	    tail = CDR(tail);
@@ -3220,6 +3484,11 @@ SEXP attribute_hidden promiseArgs(SEXP el, SEXP rho)
     return ans;
 }
 
+SEXP attribute_hidden promiseArgs(SEXP el, SEXP rho)
+{
+    return promiseArgs1(el, rho, FALSE);
+}
+
 
 /* Check that each formal is a symbol */
 
@@ -3869,14 +4138,18 @@ int DispatchGroup(const char* group, SEXP call, SEXP op, SEXP args, SEXP rho,
 }
 
 /* start of bytecode section */
-static int R_bcVersion = 12;
+static int R_bcVersion = 13;
 static int R_bcMinVersion = 9;
 
+static int bcVersion(void) { return R_bcVersion; }
+
 static SEXP R_AddSym = NULL;
 static SEXP R_SubSym = NULL;
 static SEXP R_MulSym = NULL;
 static SEXP R_DivSym = NULL;
 static SEXP R_ExptSym = NULL;
+static SEXP R_ModSym = NULL;
+static SEXP R_IdivSym = NULL;
 static SEXP R_SqrtSym = NULL;
 static SEXP R_ExpSym = NULL;
 static SEXP R_EqSym = NULL;
@@ -3918,6 +4191,8 @@ void R_initialize_bcode(void)
   R_MulSym = install("*");
   R_DivSym = install("/");
   R_ExptSym = install("^");
+  R_ModSym = install("%%");
+  R_IdivSym = install("%/%");
   R_SqrtSym = install("sqrt");
   R_ExpSym = install("exp");
   R_EqSym = install("==");
@@ -4083,6 +4358,9 @@ enum {
   DECLNK_N_OP,
   INCLNKSTK_OP,
   DECLNKSTK_OP,
+  SETVAR_POP_OP,
+  MOD_OP,
+  IDIV_OP,
   OPCOUNT
 };
 
@@ -4554,6 +4832,42 @@ static SEXP cmp_arith2(SEXP call, int opval, SEXP opsym, SEXP x, SEXP y,
 
 #include "arithmetic.h"
 
+/* %% and %/% as in integer_binary() and real_binary() in
+   arithmetic.c; the integer versions are only used for non-NA
+   arguments and a non-zero divisor. */
+#define R_MOD(x, y) myfmod(x, y)
+#define R_IDIV(x, y) myfloor(x, y)
+#define R_IMOD(x, y) \
+    (((x) >= 0 && (y) > 0) ? (x) % (y) : (int) myfmod(x, y))
+#define R_IIDIV(x, y) ((int) floor((double) (x) / (double) (y)))
+
+#define FastModDiv(op, iop, opval, opsym) do {				\
+	R_bcstack_t vvx, vvy;						\
+	R_bcstack_t *vx = bcStackScalar(R_BCNodeStackTop - 2, &vvx);	\
+	R_bcstack_t *vy = bcStackScalar(R_BCNodeStackTop - 1, &vvy);	\
+	if (vx->tag == REALSXP) {					\
+	    if (vy->tag == REALSXP)					\
+		DO_FAST_BINOP(op, vx->u.dval, vy->u.dval);		\
+	    else if (vy->tag == INTSXP && vy->u.ival != NA_INTEGER)	\
+		DO_FAST_BINOP(op, vx->u.dval, vy->u.ival);		\
+	}								\
+	else if (vx->tag == INTSXP && vx->u.ival != NA_INTEGER) {	\
+	    int ix = vx->u.ival;					\
+	    if (vy->tag == REALSXP)					\
+		DO_FAST_BINOP(op, ix, vy->u.dval);			\
+	    else if (vy->tag == INTSXP && vy->u.ival != NA_INTEGER &&	\
+		     vy->u.ival != 0) {					\
+		int iy = vy->u.ival;					\
+		SKIP_OP();						\
+		SETSTACK_INTEGER(-2, iop(ix, iy));			\
+		R_BCNodeStackTop--;					\
+		R_Visible = TRUE;					\
+		NEXT();							\
+	    }								\
+	}								\
+	Arith2(opval, opsym);						\
+    } while (0)
+
 /* The current (as of r67808) Windows toolchain compiles explicit sqrt
    calls in a way that returns a different NaN than NA_real_ when
    called with NA_real_. Not sure this is a bug in the Windows
@@ -4976,6 +5290,130 @@ typedef int BCODE;
 #define BCCODE(e) INTEGER(BCODE_CODE(e))
 #endif
 
+#ifdef R_PROFILING
+/* Sampling of byte code instructions for Rprof(bytecode.profiling =
+   TRUE).  At each profiling tick the instruction being executed by
+   the innermost active byte code interpreter is counted, by opcode
+   and by code object and offset.  The counts are written to the
+   profile file when profiling ends.  bcprof_sample is called from the
+   signal handler, so it must not allocate or signal errors. */
+
+#define BCPROF_PCTAB_SIZE 4096
+#define BCPROF_NAMELEN 64
+
+typedef struct {
+    SEXP body;
+    int relpc, opcode;
+    unsigned long count;
+    char fun[BCPROF_NAMELEN];
+} bcprof_entry;
+
+static unsigned long bcprof_opcounts[OPCOUNT];
+static bcprof_entry *bcprof_pctab = NULL;
+static unsigned long bcprof_pcdropped = 0;
+
+static int bcprof_opcode(BCODE *pc)
+{
+#ifdef THREADED_CODE
+    for (int i = 0; i < OPCOUNT; i++)
+	if (opinfo[i].addr == pc->v)
+	    return i;
+    return -1;
+#else
+    return *pc;
+#endif
+}
+
+/* name of the innermost function being called, as in the stack lines */
+static void bcprof_funname(char *buf)
+{
+    for (RCNTXT *cptr = R_GlobalContext; cptr != NULL;
+	 cptr = cptr->nextcontext)
+	if ((cptr->callflag & CTXT_FUNCTION) && TYPEOF(cptr->call) == LANGSXP) {
+	    SEXP fun = CAR(cptr->call);
+	    snprintf(buf, BCPROF_NAMELEN, "%s", TYPEOF(fun) == SYMSXP ?
+		     CHAR(PRINTNAME(fun)) : "<Anonymous>");
+	    return;
+	}
+    snprintf(buf, BCPROF_NAMELEN, "<TopLevel>");
+}
+
+static void bcprof_sample(void)
+{
+    if (! R_BCIntActive || R_BCbody == NULL || R_BCpc == NULL)
+	return;
+    BCODE *pc = *((BCODE **) R_BCpc);
+    if (pc == NULL)
+	return;
+    SEXP body = R_BCbody;
+    int m = (sizeof(BCODE) + sizeof(int) - 1) / sizeof(int);
+    ptrdiff_t relpc = pc - (BCODE *) BCCODE(body);
+    if (relpc <= 0 || relpc >= LENGTH(BCODE_CODE(body)) / m)
+	return;
+    int op = bcprof_opcode(pc);
+    if (op < 0 || op >= OPCOUNT)
+	return;
+    bcprof_opcounts[op]++;
+
+    if (bcprof_pctab == NULL)
+	return;
+    uintptr_t h = ((uintptr_t) body >> 4) * 31 + (uintptr_t) relpc;
+    int idx = (int) ((h * 0x9E3779B97F4A7C15ULL) >> 40) &
+	(BCPROF_PCTAB_SIZE - 1);
+    for (int k = 0; k < BCPROF_PCTAB_SIZE; k++) {
+	bcprof_entry *e = bcprof_pctab + idx;
+	if (e->body == body && e->relpc == relpc) {
+	    e->count++;
+	    return;
+	}
+	if (e->body == NULL) {
+	    e->body = body;
+	    e->relpc = (int) relpc;
+	    e->opcode = op;
+	    e->count = 1;
+	    bcprof_funname(e->fun);
+	    return;
+	}
+	idx = (idx + 1) & (BCPROF_PCTAB_SIZE - 1);
+    }
+    bcprof_pcdropped++;
+}
+
+static void bcprof_start(void)
+{
+    for (int i = 0; i < OPCOUNT; i++)
+	bcprof_opcounts[i] = 0;
+    bcprof_pcdropped = 0;
+    if (bcprof_pctab == NULL)
+	bcprof_pctab = calloc(BCPROF_PCTAB_SIZE, sizeof(bcprof_entry));
+    else
+	memset(bcprof_pctab, 0, BCPROF_PCTAB_SIZE * sizeof(bcprof_entry));
+}
+
+/* Lines '#Opcode <op>: <count>' give the samples per opcode, and
+   lines '#PC "<function>" <offset> <op>: <count>' those per
+   instruction, with offsets into the code as given by disassemble()
+   (where the version number is at offset 0). */
+static void bcprof_write(FILE *f)
+{
+    for (int i = 0; i < OPCOUNT; i++)
+	if (bcprof_opcounts[i])
+	    fprintf(f, "#Opcode %d: %lu\n", i, bcprof_opcounts[i]);
+    if (bcprof_pctab) {
+	for (int i = 0; i < BCPROF_PCTAB_SIZE; i++) {
+	    bcprof_entry *e = bcprof_pctab + i;
+	    if (e->body != NULL)
+		fprintf(f, "#PC \"%s\" %d %d: %lu\n",
+			e->fun, e->relpc, e->opcode, e->count);
+	}
+	free(bcprof_pctab);
+	bcprof_pctab = NULL;
+    }
+    if (bcprof_pcdropped)
+	fprintf(f, "#PC \"<Other>\" 0 -1: %lu\n", bcprof_pcdropped);
+}
+#endif
+
 /**** is there a way to avoid the locked check here? */
 /**** always boxing on lock is one option */
 #define BNDCELL_TAG_WR(v) (BINDING_IS_LOCKED(v) ? 0 : BNDCELL_TAG(v))
@@ -5388,6 +5826,52 @@ static int tryAssignDispatch(char *generic, SEXP call, SEXP lhs, SEXP rhs,
     return result;
 }
 
+/* Assign the value on top of the stack to the variable in the constant
+   pool at the next operand; 'finish' is executed when done. SETVAR
+   leaves the value on the stack. SETVAR_POP, which the compiler emits
+   for an assignment whose value is not used, also pops it, saving the
+   dispatch of a separate POP instruction. */
+#define DO_SETVAR(finish) do {						\
+    int sidx = GETOP();							\
+    SEXP loc;								\
+    if (smallcache)							\
+	loc = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);		\
+    else {								\
+	SEXP symbol = VECTOR_ELT(constants, sidx);			\
+	loc = GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);	\
+    }									\
+									\
+    R_bcstack_t *s = R_BCNodeStackTop - 1;				\
+    int tag = s->tag;							\
+									\
+    if (tag == BNDCELL_TAG_WR(loc))					\
+	switch (tag) {							\
+	case REALSXP: SET_BNDCELL_DVAL(loc, s->u.dval); finish;	\
+	case INTSXP: SET_BNDCELL_IVAL(loc, s->u.ival); finish;		\
+	case LGLSXP: SET_BNDCELL_LVAL(loc, s->u.ival); finish;		\
+	}								\
+    else if (BNDCELL_WRITABLE(loc))					\
+	switch (tag) {							\
+	case REALSXP: NEW_BNDCELL_DVAL(loc, s->u.dval); finish;	\
+	case INTSXP: NEW_BNDCELL_IVAL(loc, s->u.ival); finish;		\
+	case LGLSXP: NEW_BNDCELL_LVAL(loc, s->u.ival); finish;		\
+	}								\
+									\
+    SEXP value = GETSTACK(-1);						\
+    INCREMENT_NAMED(value);						\
+    if (! SET_BINDING_VALUE(loc, value)) {				\
+	SEXP symbol = VECTOR_ELT(constants, sidx);			\
+	PROTECT(value);							\
+	defineVar(symbol, value, rho);					\
+	UNPROTECT(1);							\
+    }									\
+} while (0)
+
+#define SETVAR_POP_NEXT() do {						\
+	BCNPOP_IGNORE_VALUE();						\
+	NEXT();								\
+    } while (0)
+
 #define DO_STARTDISPATCH(generic) do { \
   SEXP call = VECTOR_ELT(constants, GETOP()); \
   int label = GETOP(); \
@@ -6864,43 +7348,8 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
     OP(LDFALSE, 0): R_Visible = TRUE; BCNPUSH_LOGICAL(FALSE); NEXT();
     OP(GETVAR, 1): DO_GETVAR(FALSE, FALSE);
     OP(DDVAL, 1): DO_GETVAR(TRUE, FALSE);
-    OP(SETVAR, 1):
-      {
-	int sidx = GETOP();
-	SEXP loc;
-	if (smallcache)
-	    loc = GET_SMALLCACHE_BINDING_CELL(vcache, sidx);
-	else {
-	    SEXP symbol = VECTOR_ELT(constants, sidx);
-	    loc = GET_BINDING_CELL_CACHE(symbol, rho, vcache, sidx);
-	}
-
-	R_bcstack_t *s = R_BCNodeStackTop - 1;
-	int tag = s->tag;
-
-	if (tag == BNDCELL_TAG_WR(loc))
-	    switch (tag) {
-	    case REALSXP: SET_BNDCELL_DVAL(loc, s->u.dval); NEXT();
-	    case INTSXP: SET_BNDCELL_IVAL(loc, s->u.ival); NEXT();
-	    case LGLSXP: SET_BNDCELL_LVAL(loc, s->u.ival); NEXT();
-	    }
-	else if (BNDCELL_WRITABLE(loc))
-	    switch (tag) {
-	    case REALSXP: NEW_BNDCELL_DVAL(loc, s->u.dval); NEXT();
-	    case INTSXP: NEW_BNDCELL_IVAL(loc, s->u.ival); NEXT();
-	    case LGLSXP: NEW_BNDCELL_LVAL(loc, s->u.ival); NEXT();
-	    }
-
-	SEXP value = GETSTACK(-1);
-	INCREMENT_NAMED(value);
-	if (! SET_BINDING_VALUE(loc, value)) {
-	    SEXP symbol = VECTOR_ELT(constants, sidx);
-	    PROTECT(value);
-	    defineVar(symbol, value, rho);
-	    UNPROTECT(1);
-	}
-	NEXT();
-      }
+    OP(SETVAR, 1): DO_SETVAR(NEXT()); NEXT();
+    OP(SETVAR_POP, 1): DO_SETVAR(SETVAR_POP_NEXT()); SETVAR_POP_NEXT();
     OP(GETFUN, 1):
       {
 	/* get the function */
@@ -7161,6 +7610,8 @@ static SEXP bcEval(SEXP body, SEXP rho, Rboolean useCache)
     OP(MUL, 1): FastBinary(R_MUL, TIMESOP, R_MulSym);
     OP(DIV, 1): FastBinary(R_DIV, DIVOP, R_DivSym);
     OP(EXPT, 1): FastBinary(R_POW, POWOP, R_ExptSym);
+    OP(MOD, 1): FastModDiv(R_MOD, R_IMOD, MODOP, R_ModSym);
+    OP(IDIV, 1): FastModDiv(R_IDIV, R_IIDIV, IDIVOP, R_IdivSym);
     OP(SQRT, 1): FastMath1(R_sqrt, R_SqrtSym);
     OP(EXP, 1): FastMath1(exp, R_ExpSym);
     OP(EQ, 1): FastRelop2(==, EQOP, R_EqSym);
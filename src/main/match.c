@@ -181,7 +181,8 @@ SEXP attribute_hidden matchArgExact(SEXP tag, SEXP * list)
 /* Renamed to matchArgs_NR to reflect that it returns a
    non-reference-tracking list */
 
-SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
+static SEXP matchArgs_full(SEXP formals, SEXP supplied, SEXP call,
+			   int *map, Rboolean *cacheable)
 {
     Rboolean seendots;
     int i, arg_i = 0;
@@ -238,6 +239,7 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 		      if(CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 		      SET_ARGUSED(b, 2);
 		      fargused[arg_i] = 2;
+		      map[arg_i] = i;
 		  }
 	      }
 	    }
@@ -261,6 +263,7 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    if (TAG(f) == R_DotsSymbol && !seendots) {
 		/* Record where ... value goes */
 		dots = a;
+		map[arg_i] = -1;
 		seendots = TRUE;
 	    } else {
 		for (b = supplied, i = 1; b != R_NilValue; b = CDR(b), i++) {
@@ -283,6 +286,7 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 			if (CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 			SET_ARGUSED(b, 1);
 			fargused[arg_i] = 1;
+			*cacheable = FALSE;
 		    }
 		}
 	    }
@@ -303,6 +307,8 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
     a = actuals;
     b = supplied;
     seendots = FALSE;
+    arg_i = 0;
+    i = 1;
 
     while (f != R_NilValue && b != R_NilValue && !seendots) {
 	if (TAG(f) == R_DotsSymbol) {
@@ -310,11 +316,13 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    seendots = TRUE;
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
 	} else if (CAR(a) != R_MissingArg) {
 	    /* Already matched by tag */
 	    /* skip to next formal */
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
 	} else if (ARGUSED(b) || TAG(b) != R_NilValue) {
 	    /* This value used or tagged , skip to next value */
 	    /* The second test above is needed because we */
@@ -322,14 +330,18 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
 	    /* matches. */
 	    /* The formal being considered remains the same */
 	    b = CDR(b);
+	    i++;
 	} else {
 	    /* We have a positional match */
 	    SETCAR(a, CAR(b));
 	    if(CAR(b) != R_MissingArg) SET_MISSING(a, 0);
 	    SET_ARGUSED(b, 1);
+	    map[arg_i] = i;
 	    b = CDR(b);
+	    i++;
 	    f = CDR(f);
 	    a = CDR(a);
+	    arg_i++;
 	}
     }
 
@@ -382,6 +394,152 @@ SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
     return(actuals);
 }
 
+/* Cache of argument matches.  Most call sites always call the same
+   closure with the same argument tags, so the result of the matching
+   above can be recorded as a map from formals to supplied arguments
+   and re-used.  The cache is direct-mapped on the call and the
+   formals.  An entry is a list of the formals, the tags of the
+   supplied arguments and the map, which for each formal gives the
+   (1-based) position of the supplied argument matched to it, 0 if it
+   is unmatched and -1 if it is the ... collecting the remaining
+   arguments.  Keeping the formals in the entry prevents their address
+   from being re-used while it is cached.  Matches involving partial
+   matching of tags or empty arguments are not cached. */
+
+#define MATCH_CACHE_SIZE 1024
+#define MATCH_CACHE_MAXARGS 64
+
+static SEXP R_ArgMatchCache = NULL;
+
+static R_INLINE int matchCacheIndex(SEXP formals, SEXP call)
+{
+    uintptr_t h = ((uintptr_t) formals ^ ((uintptr_t) call >> 3)) >> 3;
+    return (int) ((h * 0x9E3779B97F4A7C15ULL) >> 32) & (MATCH_CACHE_SIZE - 1);
+}
+
+/* Returns the cached map, or NULL if there is none for these formals
+   and supplied arguments.  On success the supplied arguments are
+   stored in sv. */
+static R_INLINE SEXP
+matchCacheLookup(int idx, SEXP formals, SEXP supplied, SEXP *sv)
+{
+    if (R_ArgMatchCache == NULL) return NULL;
+    SEXP entry = VECTOR_ELT(R_ArgMatchCache, idx);
+    if (entry == R_NilValue || VECTOR_ELT(entry, 0) != formals)
+	return NULL;
+    SEXP tags = VECTOR_ELT(entry, 1);
+    R_xlen_t i, ns = XLENGTH(tags);
+    SEXP b;
+    for (b = supplied, i = 0; b != R_NilValue; b = CDR(b), i++) {
+	if (i == ns || TAG(b) != VECTOR_ELT(tags, i) ||
+	    CAR(b) == R_MissingArg)
+	    return NULL;
+	sv[i] = b;
+    }
+    return i == ns ? VECTOR_ELT(entry, 2) : NULL;
+}
+
+static void matchCacheInsert(int idx, SEXP formals, SEXP supplied,
+			     int ns, int nf, int *map)
+{
+    if (R_ArgMatchCache == NULL) {
+	R_ArgMatchCache = allocVector(VECSXP, MATCH_CACHE_SIZE);
+	R_PreserveObject(R_ArgMatchCache);
+    }
+    SEXP entry = PROTECT(allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(entry, 0, formals);
+    SEXP tags = allocVector(VECSXP, ns);
+    SET_VECTOR_ELT(entry, 1, tags);
+    int i = 0;
+    for (SEXP b = supplied; b != R_NilValue; b = CDR(b), i++)
+	SET_VECTOR_ELT(tags, i, TAG(b));
+    SEXP smap = allocVector(INTSXP, nf);
+    SET_VECTOR_ELT(entry, 2, smap);
+    if (nf) memcpy(INTEGER(smap), map, nf * sizeof(int));
+    SET_VECTOR_ELT(R_ArgMatchCache, idx, entry);
+    UNPROTECT(1);
+}
+
+/* Build the actuals from a cached map; the same as matchArgs_full
+   would produce. */
+static SEXP matchArgsByMap(SEXP smap, SEXP *sv, int ns)
+{
+    int nf = LENGTH(smap);
+    const int *map = INTEGER_RO(smap);
+    SEXP a, dots = R_NilValue, actuals = R_NilValue;
+    char used[ns ? ns : 1];
+    memset(used, 0, sizeof(used));
+
+    for (int k = nf - 1; k >= 0; k--) {
+	actuals = CONS_NR(R_MissingArg, actuals);
+	SET_MISSING(actuals, 1);
+	if (map[k] > 0) {
+	    SEXP b = sv[map[k] - 1];
+	    SETCAR(actuals, CAR(b));
+	    SET_MISSING(actuals, 0);
+	    used[map[k] - 1] = 1;
+	}
+	else if (map[k] < 0)
+	    dots = actuals;
+    }
+
+    if (dots != R_NilValue) {
+	/* Gobble up all unused actuals */
+	SET_MISSING(dots, 0);
+	int i, nu = 0;
+	for (i = 0; i < ns; i++) if (!used[i]) nu++;
+	if (nu) {
+	    PROTECT(actuals);
+	    a = allocList(nu);
+	    SET_TYPEOF(a, DOTSXP);
+	    SETCAR(dots, a);
+	    for (i = 0; i < ns; i++)
+		if (!used[i]) {
+		    SETCAR(a, CAR(sv[i]));
+		    SET_TAG(a, TAG(sv[i]));
+		    a = CDR(a);
+		}
+	    UNPROTECT(1);
+	}
+    }
+    return actuals;
+}
+
+SEXP attribute_hidden matchArgs_NR(SEXP formals, SEXP supplied, SEXP call)
+{
+    int ns = 0, nf = 0;
+    SEXP b;
+    for (b = supplied; b != R_NilValue && ns <= MATCH_CACHE_MAXARGS;
+	 b = CDR(b))
+	ns++;
+    Rboolean cacheable = ns <= MATCH_CACHE_MAXARGS;
+    int idx = matchCacheIndex(formals, call);
+
+    if (cacheable) {
+	SEXP sv[ns ? ns : 1];
+	SEXP smap = matchCacheLookup(idx, formals, supplied, sv);
+	if (smap != NULL)
+	    return matchArgsByMap(smap, sv, ns);
+    }
+
+    for (SEXP f = formals; f != R_NilValue; f = CDR(f)) nf++;
+    int map[nf ? nf : 1];
+    memset(map, 0, sizeof(map));
+    SEXP actuals = PROTECT(matchArgs_full(formals, supplied, call,
+					  map, &cacheable));
+    if (cacheable) {
+	for (b = supplied; b != R_NilValue; b = CDR(b))
+	    if (CAR(b) == R_MissingArg) {
+		cacheable = FALSE;
+		break;
+	    }
+	if (cacheable)
+	    matchCacheInsert(idx, formals, supplied, ns, nf, map);
+    }
+    UNPROTECT(1);
+    return actuals;
+}
+
 /* Use matchArgs_RC if the result might escape into R. */
 SEXP attribute_hidden matchArgs_RC(SEXP formals, SEXP supplied, SEXP call)
 {
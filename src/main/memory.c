@@ -90,6 +90,14 @@
 #include <R_ext/Rallocators.h> /* for R_allocator_t structure */
 #include <Rmath.h> // R_pow_di
 #include <Print.h> // R_print
+#include <Fileio.h> // R_fopen
+
+#ifndef Win32
+# include <sys/mman.h> /* for madvise */
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h> /* for sysconf */
+#endif
 
 #if defined(Win32)
 extern void *Rm_malloc(size_t n);
@@ -268,6 +276,7 @@ static void R_ReportNewPage();
 
 static void R_gc_internal(R_size_t size_needed);
 static void R_gc_no_finalizers(R_size_t size_needed);
+static void R_gc_full(int trigger);
 static void R_gc_lite();
 static void mem_err_heap(R_size_t size);
 static void mem_err_malloc(R_size_t size);
@@ -294,7 +303,10 @@ static SEXPREC UnmarkedNodeTemplate;
    after every LEVEL_1_FREQ level 1 collections a level 2 collection
    occurs.  Thus, roughly, every LEVEL_0_FREQ-th collection is a level
    1 collection and every (LEVEL_0_FREQ * LEVEL_1_FREQ)-th collection
-   is a level 2 collection.  */
+   is a level 2 collection.  The frequencies can be set at startup by
+   the environment variables R_GC_LEVEL0_FREQ and R_GC_LEVEL1_FREQ;
+   larger values keep survivors in the older generations for longer
+   before these generations are collected again.  */
 #define LEVEL_0_FREQ 20
 #define LEVEL_1_FREQ 5
 static int collect_counts_max[] = { LEVEL_0_FREQ, LEVEL_1_FREQ };
@@ -316,6 +328,20 @@ static double R_MinFreeFrac = 0.2;
 static double R_MaxKeepFrac = 0.5;
 static int R_PageReleaseFreq = 1;
 
+/* Lazy Sweeping.  When the environment variable R_GC_LAZY_SWEEP is set
+   to a true value, work proportional to the heap size rather than to
+   the live data is moved out of the collection pause.  Large vectors
+   found to be free are queued instead of being returned to malloc
+   immediately; the queue is drained LAZY_SWEEP_FREE_COUNT vectors at a
+   time by subsequent large vector and page allocations and completely
+   at the next collection.  The scan of the small node pages for pages
+   to release examines at most R_PageReleaseScanMax pages of each class
+   per collection, resuming at the next collection where the previous
+   scan stopped. */
+static Rboolean gc_lazy_sweep = FALSE;
+#define LAZY_SWEEP_FREE_COUNT 2
+static int R_PageReleaseScanMax = 1000;
+
 /* The heap size constants R_NSize and R_VSize are used for triggering
    collections.  The initial values set by defaults or command line
    arguments are used as minimal values.  After full collections these
@@ -547,10 +573,63 @@ static int NodeClassSize[NUM_SMALL_NODE_CLASSES] = { 0, 1, 2, 4, 8, 16 };
     (NODE_IS_MARKED(x) && (y) && \
    (! NODE_IS_MARKED(y) || NODE_GENERATION(x) > NODE_GENERATION(y)))
 
+/* The number of old generations in use can be reduced at startup by
+   setting the environment variable R_GC_GENERATIONS.  With a single
+   old generation survivors of a level 0 collection are promoted
+   directly to the oldest generation and every level 1 collection is
+   a full collection. */
+static int num_old_generations = NUM_OLD_GENERATIONS;
+
 static int num_old_gens_to_collect = 0;
 static int gen_gc_counts[NUM_OLD_GENERATIONS + 1];
 static int collect_counts[NUM_OLD_GENERATIONS];
 
+/* Survival statistics: the numbers of nodes subject to collection and
+   of nodes surviving in collections at each level. */
+static double gen_gc_examined[NUM_OLD_GENERATIONS + 1];
+static double gen_gc_survived[NUM_OLD_GENERATIONS + 1];
+
+/* Nodes surviving a collection of an old generation other than the
+   oldest are promoted to the next generation only by every
+   promotion_age-th collection of their generation, set at startup by
+   R_GC_PROMOTION_AGE; otherwise they stay where they are.  There is no
+   room in the node header for the age of each node, so this is done
+   for all the nodes of a generation at once. */
+static int promotion_age = 1;
+static int promotion_counts[NUM_OLD_GENERATIONS];
+
+static void init_gc_generation_settings(void)
+{
+    char *arg;
+
+    arg = getenv("R_GC_GENERATIONS");
+    if (arg != NULL) {
+	int gens = atoi(arg);
+	if (1 <= gens && gens <= NUM_OLD_GENERATIONS)
+	    num_old_generations = gens;
+    }
+    arg = getenv("R_GC_LEVEL0_FREQ");
+    if (arg != NULL) {
+	int freq = atoi(arg);
+	if (freq >= 1)
+	    collect_counts_max[0] = freq;
+    }
+    arg = getenv("R_GC_LEVEL1_FREQ");
+    if (arg != NULL) {
+	int freq = atoi(arg);
+	if (freq >= 1)
+	    collect_counts_max[1] = freq;
+    }
+    arg = getenv("R_GC_PROMOTION_AGE");
+    if (arg != NULL) {
+	int age = atoi(arg);
+	if (age >= 1)
+	    promotion_age = age;
+    }
+    for (int gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
+	promotion_counts[gen] = promotion_age;
+}
+
 
 /* Node Pages.  Non-vector nodes and small vector nodes are allocated
    from fixed size pages.  The pages for each node class are kept in a
@@ -931,6 +1010,19 @@ static void DEBUG_RELEASE_PRINT(int rel_pages, int maxrel_pages, int i)
 #define INIT_REFCNT(x) do {} while (0)
 #endif
 
+/* Large vectors freed by a lazy sweep and not yet returned to malloc,
+   chained through their NEXT_NODE fields. */
+static SEXP R_PendingLargeFree = NULL;
+
+static void FreePendingLargeVectors(int max)
+{
+    for (int n = 0; R_PendingLargeFree != NULL && (max < 0 || n < max); n++) {
+	SEXP s = R_PendingLargeFree;
+	R_PendingLargeFree = NEXT_NODE(s);
+	free(s);
+    }
+}
+
 /* Page Allocation and Release. */
 
 static void GetNewPage(int node_class)
@@ -940,6 +1032,9 @@ static void GetNewPage(int node_class)
     PAGE_HEADER *page;
     int node_size, page_count, i;  // FIXME: longer type?
 
+    if (R_PendingLargeFree != NULL)
+	FreePendingLargeVectors(LAZY_SWEEP_FREE_COUNT);
+
     node_size = NODE_SIZE(node_class);
     page_count = (R_PAGE_SIZE - sizeof(PAGE_HEADER)) / node_size;
 
@@ -997,6 +1092,10 @@ static void ReleasePage(PAGE_HEADER *page, int node_class)
     free(page);
 }
 
+/* the page after which a lazy scan for releasable pages resumes, or
+   NULL to start at the head of the page list */
+static PAGE_HEADER *R_PageReleaseCursor[NUM_SMALL_NODE_CLASSES];
+
 static void TryToReleasePages(void)
 {
     SEXP s;
@@ -1011,6 +1110,7 @@ static void TryToReleasePages(void)
 	    int node_size = NODE_SIZE(i);
 	    int page_count = (R_PAGE_SIZE - sizeof(PAGE_HEADER)) / node_size;
 	    int maxrel, maxrel_pages, rel_pages, gen;
+	    int scan_pages = gc_lazy_sweep ? R_PageReleaseScanMax : -1;
 
 	    maxrel = R_GenHeap[i].AllocCount;
 	    for (gen = 0; gen < NUM_OLD_GENERATIONS; gen++)
@@ -1018,9 +1118,19 @@ static void TryToReleasePages(void)
 				R_GenHeap[i].OldCount[gen]);
 	    maxrel_pages = maxrel > 0 ? maxrel / page_count : 0;
 
+	    if (gc_lazy_sweep && R_PageReleaseCursor[i] != NULL) {
+		last = R_PageReleaseCursor[i];
+		page = last->next;
+	    }
+	    else {
+		last = NULL;
+		page = R_GenHeap[i].pages;
+	    }
+
 	    /* all nodes in New space should be both free and unmarked */
-	    for (page = R_GenHeap[i].pages, rel_pages = 0, last = NULL;
-		 rel_pages < maxrel_pages && page != NULL;) {
+	    for (rel_pages = 0;
+		 rel_pages < maxrel_pages && page != NULL && scan_pages != 0;
+		 scan_pages--) {
 		int j, in_use;
 		char *data = PAGE_DATA(page);
 
@@ -1045,6 +1155,8 @@ static void TryToReleasePages(void)
 		else last = page;
 		page = next;
 	    }
+	    if (gc_lazy_sweep)
+		R_PageReleaseCursor[i] = page != NULL ? last : NULL;
 	    DEBUG_RELEASE_PRINT(rel_pages, maxrel_pages, i);
 	    R_GenHeap[i].Free = NEXT_NODE(R_GenHeap[i].New);
 	}
@@ -1090,6 +1202,107 @@ static R_INLINE R_size_t getVecSizeInVEC(SEXP s)
 
 static void custom_node_free(void *ptr);
 
+/* Large Vector Pool.  When the environment variable R_GC_LARGE_POOL is
+   set at startup to a number of megabytes, memory for large vectors
+   of between 64Kb and 1Gb is allocated in size classes, four per
+   power of two, and blocks released by the collector are kept, up to
+   the given total size, in per-class free lists for reuse by later
+   allocations instead of being returned to malloc.  This avoids the
+   cost of malloc/free and of the page faults on fresh memory for
+   computations that repeatedly allocate and discard large temporary
+   vectors.  The pool is emptied by explicit full collections and
+   before retrying failed allocations.
+
+   If R_GC_HUGEPAGES is set to a true value, newly allocated blocks of
+   at least 2Mb are marked as eligible for transparent huge pages
+   where this is supported. */
+#define LARGE_POOL_MIN_LOG2 16
+#define LARGE_POOL_MAX_LOG2 30
+#define LARGE_POOL_SUBCLASSES 4
+#define LARGE_POOL_CLASSES \
+    ((LARGE_POOL_MAX_LOG2 - LARGE_POOL_MIN_LOG2) * LARGE_POOL_SUBCLASSES)
+#define HUGEPAGE_MIN_SIZE (2 * 1024 * 1024)
+
+static void *R_LargePool[LARGE_POOL_CLASSES];
+static R_size_t R_LargePoolMax = 0; /* in bytes; zero if not in use */
+static R_size_t R_LargePoolSize = 0;
+static double R_LargePoolHits = 0, R_LargePoolMisses = 0;
+static Rboolean R_UseHugePages = FALSE;
+static uintptr_t R_PageSize = 4096; /* set from sysconf() if huge pages are used */
+
+/* Returns the pool class for a block of 'bytes' bytes, or -1 if blocks
+   of this size are not pooled.  The size of the class is returned in
+   'csize'. */
+static int LargePoolClass(R_size_t bytes, R_size_t *csize)
+{
+    if (R_LargePoolMax == 0 ||
+	bytes <= ((R_size_t) 1 << LARGE_POOL_MIN_LOG2) ||
+	bytes > ((R_size_t) 1 << LARGE_POOL_MAX_LOG2))
+	return -1;
+
+    int k = LARGE_POOL_MIN_LOG2;
+    while (((R_size_t) 1 << (k + 1)) < bytes) k++;
+    R_size_t base = (R_size_t) 1 << k;
+    R_size_t step = base / LARGE_POOL_SUBCLASSES;
+    int j = (int) ((bytes - base + step - 1) / step) - 1;
+    *csize = base + (j + 1) * step;
+    return (k - LARGE_POOL_MIN_LOG2) * LARGE_POOL_SUBCLASSES + j;
+}
+
+static void *LargeVectorAlloc(R_size_t bytes)
+{
+    R_size_t csize;
+    int c = LargePoolClass(bytes, &csize);
+    if (c >= 0) {
+	void *mem = R_LargePool[c];
+	if (mem != NULL) {
+	    R_LargePool[c] = *((void **) mem);
+	    R_LargePoolSize -= csize;
+	    R_LargePoolHits++;
+	    return mem;
+	}
+	R_LargePoolMisses++;
+	bytes = csize;
+    }
+
+    void *mem = malloc(bytes);
+#if !defined(Win32) && defined(MADV_HUGEPAGE)
+    if (R_UseHugePages && mem != NULL && bytes >= HUGEPAGE_MIN_SIZE) {
+	/* advise the page-aligned part of the block */
+	uintptr_t psize = R_PageSize;
+	uintptr_t start = ((uintptr_t) mem + psize - 1) & ~(psize - 1);
+	uintptr_t end = ((uintptr_t) mem + bytes) & ~(psize - 1);
+	if (end > start)
+	    madvise((void *) start, end - start, MADV_HUGEPAGE);
+    }
+#endif
+    return mem;
+}
+
+/* Returns TRUE if the block was placed in the pool. */
+static Rboolean LargePoolRelease(void *mem, R_size_t bytes)
+{
+    R_size_t csize;
+    int c = LargePoolClass(bytes, &csize);
+    if (c < 0 || R_LargePoolSize + csize > R_LargePoolMax)
+	return FALSE;
+    *((void **) mem) = R_LargePool[c];
+    R_LargePool[c] = mem;
+    R_LargePoolSize += csize;
+    return TRUE;
+}
+
+static void FlushLargePool(void)
+{
+    for (int c = 0; c < LARGE_POOL_CLASSES; c++)
+	while (R_LargePool[c] != NULL) {
+	    void *mem = R_LargePool[c];
+	    R_LargePool[c] = *((void **) mem);
+	    free(mem);
+	}
+    R_LargePoolSize = 0;
+}
+
 static void ReleaseLargeFreeVectors()
 {
     for (int node_class = CUSTOM_NODE_CLASS; node_class <= LARGE_NODE_CLASS; node_class++) {
@@ -1111,7 +1324,14 @@ static void ReleaseLargeFreeVectors()
 		R_GenHeap[node_class].AllocCount--;
 		if (node_class == LARGE_NODE_CLASS) {
 		    R_LargeVallocSize -= size;
-		    free(s);
+		    R_size_t bytes = sizeof(SEXPREC_ALIGN) + size * sizeof(VECREC);
+		    if (LargePoolRelease(s, bytes))
+			; /* kept for reuse */
+		    else if (gc_lazy_sweep) {
+			SET_NEXT_NODE(s, R_PendingLargeFree);
+			R_PendingLargeFree = s;
+		    }
+		    else free(s);
 		} else {
 		    custom_node_free(s);
 		}
@@ -1626,17 +1846,64 @@ SEXP attribute_hidden do_regFinaliz(SEXP call, SEXP op, SEXP args, SEXP rho)
     } \
 } while (0)
 
+/* Elapsed times of the phases of the collector.  The mark phase
+   covers aging of old-to-new references, forwarding of the roots and
+   processing of the forwarded nodes, weak references and the CHARSXP
+   cache; the sweep phase releases large vectors and resets the free
+   lists; the adjust phase covers heap size adjustment and page
+   release.  Cumulative totals are kept along with the times for the
+   most recent collection; these are reported by gcinfo(TRUE) and
+   gc.stats(). */
+#define GC_PHASE_MARK   0
+#define GC_PHASE_SWEEP  1
+#define GC_PHASE_ADJUST 2
+#define NUM_GC_PHASES   3
+static double gc_phase_times[NUM_GC_PHASES];
+static double gc_last_phase_times[NUM_GC_PHASES];
+static double gc_max_pause = 0;
+
+/* GC Event Tracing.  A record of each collection, giving its level,
+   what triggered it, the time spent in each phase, the numbers of
+   nodes and of bytes of small and large vector memory it freed and
+   the heap sizes after any adjustment, is kept in a ring buffer
+   holding the most recent GC_EVENT_BUFSIZE collections, which is
+   returned to R by gc.events().  If the environment variable
+   R_GC_TRACE_FILE is set at start-up the records are also appended
+   to that file in JSON lines format. */
+#define GC_TRIGGER_CONS     0
+#define GC_TRIGGER_VECTOR   1
+#define GC_TRIGGER_EXPLICIT 2
+#define GC_TRIGGER_FORCED   3
+#define GC_TRIGGER_MALLOC   4
+static const char * const gc_trigger_names[] =
+    { "cons", "vector", "explicit", "forced", "malloc" };
+#define GC_EVENT_BUFSIZE 256
+
+typedef struct {
+    int count, level, trigger;
+    double phases[NUM_GC_PHASES];
+    double nodes_freed, small_bytes_freed, large_bytes_freed;
+    double nsize, vsize;
+} R_GCEvent;
+
+static R_GCEvent gc_events[GC_EVENT_BUFSIZE];
+static int gc_events_next = 0, gc_events_used = 0;
+static int gc_request_trigger = -1; /* trigger of a requested collection */
+static FILE *gc_trace_file = NULL;
+
 static int RunGenCollect(R_size_t size_needed)
 {
     int i, gen, gens_collected;
     RCNTXT *ctxt;
     SEXP s;
     SEXP forwarded_nodes;
+    double phase_start, phase_end;
+    R_size_t uncollected;
 
     bad_sexp_type_seen = 0;
 
     /* determine number of generations to collect */
-    while (num_old_gens_to_collect < NUM_OLD_GENERATIONS) {
+    while (num_old_gens_to_collect < num_old_generations) {
 	if (collect_counts[num_old_gens_to_collect]-- <= 0) {
 	    collect_counts[num_old_gens_to_collect] =
 		collect_counts_max[num_old_gens_to_collect];
@@ -1646,11 +1913,21 @@ static int RunGenCollect(R_size_t size_needed)
     }
 
 #ifdef PROTECTCHECK
-    num_old_gens_to_collect = NUM_OLD_GENERATIONS;
+    num_old_gens_to_collect = num_old_generations;
 #endif
 
+    for (i = 0; i < NUM_GC_PHASES; i++)
+	gc_last_phase_times[i] = 0;
+
  again:
     gens_collected = num_old_gens_to_collect;
+    phase_start = currentTime();
+
+    uncollected = 0;
+    for (gen = gens_collected; gen < num_old_generations; gen++)
+	for (i = 0; i < NUM_NODE_CLASSES; i++)
+	    uncollected += R_GenHeap[i].OldCount[gen];
+    gen_gc_examined[gens_collected] += R_NodesInUse - uncollected;
 
 #ifndef EXPEL_OLD_TO_NEW
     /* eliminate old-to-new references in generations to collect by
@@ -1676,12 +1953,17 @@ static int RunGenCollect(R_size_t size_needed)
     /* unmark all marked nodes in old generations to be collected and
        move to New space */
     for (gen = 0; gen < num_old_gens_to_collect; gen++) {
+	Rboolean promote = FALSE;
+	if (gen < num_old_generations - 1 && --promotion_counts[gen] <= 0) {
+	    promote = TRUE;
+	    promotion_counts[gen] = promotion_age;
+	}
 	for (i = 0; i < NUM_NODE_CLASSES; i++) {
 	    R_GenHeap[i].OldCount[gen] = 0;
 	    s = NEXT_NODE(R_GenHeap[i].Old[gen]);
 	    while (s != R_GenHeap[i].Old[gen]) {
 		SEXP next = NEXT_NODE(s);
-		if (gen < NUM_OLD_GENERATIONS - 1)
+		if (promote)
 		    SET_NODE_GENERATION(s, gen + 1);
 		UNMARK_NODE(s);
 		s = next;
@@ -1695,7 +1977,7 @@ static int RunGenCollect(R_size_t size_needed)
 
 #ifndef EXPEL_OLD_TO_NEW
     /* scan nodes in uncollected old generations with old-to-new pointers */
-    for (gen = num_old_gens_to_collect; gen < NUM_OLD_GENERATIONS; gen++)
+    for (gen = num_old_gens_to_collect; gen < num_old_generations; gen++)
 	for (i = 0; i < NUM_NODE_CLASSES; i++)
 	    for (s = NEXT_NODE(R_GenHeap[i].OldToNew[gen]);
 		 s != R_GenHeap[i].OldToNew[gen];
@@ -1821,6 +2103,23 @@ static int RunGenCollect(R_size_t size_needed)
 
     DEBUG_CHECK_NODE_COUNTS("after processing forwarded list");
 
+    /* process the match() hash table cache: entries whose table is
+       otherwise unreachable are dropped.  This must precede the
+       CHARSXP cache as a cached table may hold the only references
+       to some strings. */
+    if (R_MatchCache != NULL) {
+	for (i = 0; i < LENGTH(R_MatchCache); i++) {
+	    s = VECTOR_ELT(R_MatchCache, i);
+	    if (s == R_NilValue) continue;
+	    if (! NODE_IS_MARKED(VECTOR_ELT(s, 0)))
+		((SEXP *) STDVEC_DATAPTR(R_MatchCache))[i] = R_NilValue;
+	    else
+		FORWARD_NODE(s);
+	}
+	FORWARD_NODE(R_MatchCache);
+	PROCESS_NODES();
+    }
+
     /* process CHARSXP cache */
     if (R_StringHash != NULL) /* in case of GC during initialization */
     {
@@ -1832,7 +2131,7 @@ static int RunGenCollect(R_size_t size_needed)
 	    while (s != R_NilValue) {
 		if (! NODE_IS_MARKED(CXHEAD(s))) { /* remove unused CHARSXP and cons cell */
 		    if (t == R_NilValue) /* head of list */
-			VECTOR_ELT(R_StringHash, i) = CXTAIL(s);
+			((SEXP *) STDVEC_DATAPTR(R_StringHash))[i] = CXTAIL(s);
 		    else
 			CXTAIL(t) = CXTAIL(s);
 		    s = CXTAIL(s);
@@ -1892,7 +2191,12 @@ static int RunGenCollect(R_size_t size_needed)
 	PROCESS_NODES();
 #endif
 
+    phase_end = currentTime();
+    gc_last_phase_times[GC_PHASE_MARK] += phase_end - phase_start;
+    phase_start = phase_end;
+
     /* release large vector allocations */
+    FreePendingLargeVectors(-1);
     ReleaseLargeFreeVectors();
 
     DEBUG_CHECK_NODE_COUNTS("after releasing large allocated nodes");
@@ -1924,8 +2228,13 @@ static int RunGenCollect(R_size_t size_needed)
 	    R_Collected -= R_GenHeap[i].OldCount[gen];
     }
     R_NodesInUse = R_NSize - R_Collected;
+    gen_gc_survived[gens_collected] += R_NodesInUse - uncollected;
 
-    if (num_old_gens_to_collect < NUM_OLD_GENERATIONS) {
+    phase_end = currentTime();
+    gc_last_phase_times[GC_PHASE_SWEEP] += phase_end - phase_start;
+    phase_start = phase_end;
+
+    if (num_old_gens_to_collect < num_old_generations) {
 	if (R_Collected < R_MinFreeFrac * R_NSize ||
 	    VHEAP_FREE() < size_needed + R_MinFreeFrac * R_VSize) {
 	    num_old_gens_to_collect++;
@@ -1938,7 +2247,7 @@ static int RunGenCollect(R_size_t size_needed)
 
     gen_gc_counts[gens_collected]++;
 
-    if (gens_collected == NUM_OLD_GENERATIONS) {
+    if (gens_collected == num_old_generations) {
 	/**** do some adjustment for intermediate collections? */
 	AdjustHeapSize(size_needed);
 	TryToReleasePages();
@@ -1949,10 +2258,14 @@ static int RunGenCollect(R_size_t size_needed)
 	DEBUG_CHECK_NODE_COUNTS("after heap adjustment");
     }
 #ifdef SORT_NODES
-    if (gens_collected == NUM_OLD_GENERATIONS)
+    if (gens_collected == num_old_generations)
 	SortNodes();
 #endif
 
+    gc_last_phase_times[GC_PHASE_ADJUST] += currentTime() - phase_start;
+    for (i = 0; i < NUM_GC_PHASES; i++)
+	gc_phase_times[i] += gc_last_phase_times[i];
+
     return gens_collected;
 }
 
@@ -2135,6 +2448,7 @@ void attribute_hidden InitMemory()
 
     init_gctorture();
     init_gc_grow_settings();
+    init_gc_generation_settings();
 
     arg = getenv("_R_GC_FAIL_ON_ERROR_");
     if (arg != NULL && StringTrue(arg))
@@ -2142,6 +2456,33 @@ void attribute_hidden InitMemory()
     else if (arg != NULL && StringFalse(arg))
 	gc_fail_on_error = FALSE;
 
+    arg = getenv("R_GC_LAZY_SWEEP");
+    if (arg != NULL && StringTrue(arg))
+	gc_lazy_sweep = TRUE;
+
+    arg = getenv("R_GC_LARGE_POOL");
+    if (arg != NULL) {
+	double mb = atof(arg);
+	if (mb > 0 && mb < R_SIZE_T_MAX / Mega)
+	    R_LargePoolMax = (R_size_t) (mb * Mega);
+    }
+    arg = getenv("R_GC_HUGEPAGES");
+    if (arg != NULL && StringTrue(arg)) {
+	R_UseHugePages = TRUE;
+#if defined(HAVE_UNISTD_H) && defined(_SC_PAGESIZE)
+	long psize = sysconf(_SC_PAGESIZE);
+	if (psize > 0 && (psize & (psize - 1)) == 0) /* a power of two */
+	    R_PageSize = (uintptr_t) psize;
+#endif
+    }
+
+    arg = getenv("R_GC_TRACE_FILE");
+    if (arg != NULL && arg[0] != '\0') {
+	gc_trace_file = R_fopen(R_ExpandFileName(arg), "a");
+	if (gc_trace_file == NULL)
+	    REprintf("cannot open GC trace file '%s'\n", arg);
+    }
+
     gc_reporting = R_Verbose;
     R_StandardPPStackSize = R_PPStackSize;
     R_RealPPStackSize = R_PPStackSize + PP_REDZONE_SIZE;
@@ -2328,7 +2669,7 @@ void *R_malloc_gc(size_t n)
 {
     void *np = malloc(n);
     if (np == NULL) {
-	R_gc();
+	R_gc_full(GC_TRIGGER_MALLOC);
 	np = malloc(n);
     }
     return np;
@@ -2338,7 +2679,7 @@ void *R_calloc_gc(size_t n, size_t s)
 {
     void *np = calloc(n, s);
     if (np == NULL) {
-	R_gc();
+	R_gc_full(GC_TRIGGER_MALLOC);
 	np = calloc(n, s);
     }
     return np;
@@ -2348,7 +2689,7 @@ void *R_realloc_gc(void *p, size_t n)
 {
     void *np = realloc(p, n);
     if (np == NULL) {
-	R_gc();
+	R_gc_full(GC_TRIGGER_MALLOC);
 	np = realloc(p, n);
     }
     return np;
@@ -2795,6 +3136,8 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 	    Rboolean success = FALSE;
 	    R_size_t hdrsize = sizeof(SEXPREC_ALIGN);
 	    void *mem = NULL; /* initialize to suppress warning */
+	    if (R_PendingLargeFree != NULL)
+		FreePendingLargeVectors(LAZY_SWEEP_FREE_COUNT);
 	    if (size < (R_SIZE_T_MAX / sizeof(VECREC)) - hdrsize) { /*** not sure this test is quite right -- why subtract the header? LT */
 		/* I think subtracting the header is fine, "size" (*VSize)
 		   variables do not count the header, but the header is
@@ -2803,7 +3146,7 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 		   indexable by size_t. - TK */
 		mem = allocator ?
 		    custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-		    malloc(hdrsize + size * sizeof(VECREC));
+		    LargeVectorAlloc(hdrsize + size * sizeof(VECREC));
 		if (mem == NULL) {
 		    /* If we are near the address space limit, we
 		       might be short of address space.  So return
@@ -2811,7 +3154,7 @@ SEXP allocVector3(SEXPTYPE type, R_xlen_t length, R_allocator_t *allocator)
 		    R_gc_no_finalizers(alloc_size);
 		    mem = allocator ?
 			custom_node_alloc(allocator, hdrsize + size * sizeof(VECREC)) :
-			malloc(hdrsize + size * sizeof(VECREC));
+			LargeVectorAlloc(hdrsize + size * sizeof(VECREC));
 		}
 		if (mem != NULL) {
 		    s = mem;
@@ -2977,27 +3320,40 @@ SEXP allocFormalsList6(SEXP sym1, SEXP sym2, SEXP sym3, SEXP sym4,
 
 /* "gc" a mark-sweep or in-place generational garbage collector */
 
-void R_gc(void)
+static void R_gc_full(int trigger)
 {
-    num_old_gens_to_collect = NUM_OLD_GENERATIONS;
+    num_old_gens_to_collect = num_old_generations;
+    gc_request_trigger = trigger;
     R_gc_internal(0);
+    FreePendingLargeVectors(-1);
+    FlushLargePool();
 #ifndef IMMEDIATE_FINALIZERS
     R_RunPendingFinalizers();
 #endif
 }
 
+void R_gc(void)
+{
+    R_gc_full(GC_TRIGGER_EXPLICIT);
+}
+
 void R_gc_lite(void)
 {
+    gc_request_trigger = GC_TRIGGER_EXPLICIT;
     R_gc_internal(0);
 #ifndef IMMEDIATE_FINALIZERS
     R_RunPendingFinalizers();
 #endif
 }
 
+/* Used when malloc fails, to return all unused memory to malloc. */
 static void R_gc_no_finalizers(R_size_t size_needed)
 {
-    num_old_gens_to_collect = NUM_OLD_GENERATIONS;
+    num_old_gens_to_collect = num_old_generations;
+    gc_request_trigger = GC_TRIGGER_MALLOC;
     R_gc_internal(size_needed);
+    FreePendingLargeVectors(-1);
+    FlushLargePool();
 }
 
 static double gctimes[5], gcstarttimes[5];
@@ -3023,6 +3379,126 @@ SEXP attribute_hidden do_gctime(SEXP call, SEXP op, SEXP args, SEXP env)
     return ans;
 }
 
+/* .Internal(gc.stats()) returns a list of collector statistics: the
+   number of collections at each level, the fraction of nodes subject
+   to collection surviving at each level, the current numbers of nodes
+   in the old generations and the cumulative elapsed time spent in
+   each phase of the collector, with the longest pause, and the use of
+   the large vector pool. */
+SEXP attribute_hidden do_gcstats(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP ans, nms, counts, survival, gens, phases, pool;
+    int gen, i;
+
+    checkArity(op, args);
+    PROTECT(ans = allocVector(VECSXP, 6));
+    nms = allocVector(STRSXP, 6);
+    setAttrib(ans, R_NamesSymbol, nms);
+    SET_STRING_ELT(nms, 0, mkChar("collections"));
+    SET_STRING_ELT(nms, 1, mkChar("survival"));
+    SET_STRING_ELT(nms, 2, mkChar("generations"));
+    SET_STRING_ELT(nms, 3, mkChar("phases"));
+    SET_STRING_ELT(nms, 4, mkChar("max.pause"));
+    SET_STRING_ELT(nms, 5, mkChar("large.pool"));
+
+    counts = allocVector(INTSXP, num_old_generations + 1);
+    SET_VECTOR_ELT(ans, 0, counts);
+    survival = allocVector(REALSXP, num_old_generations + 1);
+    SET_VECTOR_ELT(ans, 1, survival);
+    nms = allocVector(STRSXP, num_old_generations + 1);
+    setAttrib(counts, R_NamesSymbol, nms);
+    setAttrib(survival, R_NamesSymbol, nms);
+    for (gen = 0; gen <= num_old_generations; gen++) {
+	char buf[20];
+	INTEGER(counts)[gen] = gen_gc_counts[gen];
+	REAL(survival)[gen] = gen_gc_examined[gen] > 0 ?
+	    gen_gc_survived[gen] / gen_gc_examined[gen] : NA_REAL;
+	snprintf(buf, 20, "level%d", gen);
+	SET_STRING_ELT(nms, gen, mkChar(buf));
+    }
+
+    gens = allocVector(REALSXP, num_old_generations);
+    SET_VECTOR_ELT(ans, 2, gens);
+    nms = allocVector(STRSXP, num_old_generations);
+    setAttrib(gens, R_NamesSymbol, nms);
+    for (gen = 0; gen < num_old_generations; gen++) {
+	char buf[20];
+	double n = 0;
+	for (i = 0; i < NUM_NODE_CLASSES; i++)
+	    n += R_GenHeap[i].OldCount[gen];
+	REAL(gens)[gen] = n;
+	snprintf(buf, 20, "gen%d", gen + 1);
+	SET_STRING_ELT(nms, gen, mkChar(buf));
+    }
+
+    phases = allocVector(REALSXP, NUM_GC_PHASES);
+    SET_VECTOR_ELT(ans, 3, phases);
+    nms = allocVector(STRSXP, NUM_GC_PHASES);
+    setAttrib(phases, R_NamesSymbol, nms);
+    REAL(phases)[GC_PHASE_MARK] = gc_phase_times[GC_PHASE_MARK];
+    REAL(phases)[GC_PHASE_SWEEP] = gc_phase_times[GC_PHASE_SWEEP];
+    REAL(phases)[GC_PHASE_ADJUST] = gc_phase_times[GC_PHASE_ADJUST];
+    SET_STRING_ELT(nms, GC_PHASE_MARK, mkChar("mark"));
+    SET_STRING_ELT(nms, GC_PHASE_SWEEP, mkChar("sweep"));
+    SET_STRING_ELT(nms, GC_PHASE_ADJUST, mkChar("adjust"));
+
+    SET_VECTOR_ELT(ans, 4, ScalarReal(gc_max_pause));
+
+    pool = allocVector(REALSXP, 3);
+    SET_VECTOR_ELT(ans, 5, pool);
+    nms = allocVector(STRSXP, 3);
+    setAttrib(pool, R_NamesSymbol, nms);
+    REAL(pool)[0] = R_LargePoolHits;
+    REAL(pool)[1] = R_LargePoolMisses;
+    REAL(pool)[2] = (double) R_LargePoolSize;
+    SET_STRING_ELT(nms, 0, mkChar("hits"));
+    SET_STRING_ELT(nms, 1, mkChar("misses"));
+    SET_STRING_ELT(nms, 2, mkChar("cached"));
+    UNPROTECT(1);
+    return ans;
+}
+
+/* gc.events() returns the records in the GC event ring buffer, oldest
+   first, as a list of columns which the R wrapper makes into a data
+   frame. */
+SEXP attribute_hidden do_gcevents(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    const char *names[] = { "gc", "level", "trigger", "mark", "sweep",
+			    "adjust", "nodes.freed", "small.bytes.freed",
+			    "large.bytes.freed", "nsize", "vsize" };
+    int ncols = (int) (sizeof(names) / sizeof(names[0]));
+    int n = gc_events_used;
+    int first = (gc_events_next - n + GC_EVENT_BUFSIZE) % GC_EVENT_BUFSIZE;
+    SEXP ans, nms, col;
+
+    checkArity(op, args);
+    PROTECT(ans = allocVector(VECSXP, ncols));
+    nms = allocVector(STRSXP, ncols);
+    setAttrib(ans, R_NamesSymbol, nms);
+    for (int j = 0; j < ncols; j++) {
+	SET_STRING_ELT(nms, j, mkChar(names[j]));
+	SET_VECTOR_ELT(ans, j, allocVector(j < 2 ? INTSXP :
+					   (j == 2 ? STRSXP : REALSXP), n));
+    }
+    for (int i = 0; i < n; i++) {
+	R_GCEvent *e = gc_events + (first + i) % GC_EVENT_BUFSIZE;
+	INTEGER(VECTOR_ELT(ans, 0))[i] = e->count;
+	INTEGER(VECTOR_ELT(ans, 1))[i] = e->level;
+	col = VECTOR_ELT(ans, 2);
+	SET_STRING_ELT(col, i, mkChar(gc_trigger_names[e->trigger]));
+	REAL(VECTOR_ELT(ans, 3))[i] = e->phases[GC_PHASE_MARK];
+	REAL(VECTOR_ELT(ans, 4))[i] = e->phases[GC_PHASE_SWEEP];
+	REAL(VECTOR_ELT(ans, 5))[i] = e->phases[GC_PHASE_ADJUST];
+	REAL(VECTOR_ELT(ans, 6))[i] = e->nodes_freed;
+	REAL(VECTOR_ELT(ans, 7))[i] = e->small_bytes_freed;
+	REAL(VECTOR_ELT(ans, 8))[i] = e->large_bytes_freed;
+	REAL(VECTOR_ELT(ans, 9))[i] = e->nsize;
+	REAL(VECTOR_ELT(ans, 10))[i] = e->vsize;
+    }
+    UNPROTECT(1);
+    return ans;
+}
+
 static void gc_start_timing(void)
 {
     if (gctime_enabled)
@@ -3078,16 +3554,55 @@ void attribute_hidden R_check_thread(const char *s) {}
 # endif
 #endif
 
+static void RecordGCEvent(int level, int trigger, R_size_t nodes_before,
+			  R_size_t small_before, R_size_t large_before)
+{
+    R_GCEvent *e = gc_events + gc_events_next;
+    gc_events_next = (gc_events_next + 1) % GC_EVENT_BUFSIZE;
+    if (gc_events_used < GC_EVENT_BUFSIZE)
+	gc_events_used++;
+
+    e->count = gc_count;
+    e->level = level;
+    e->trigger = trigger;
+    for (int i = 0; i < NUM_GC_PHASES; i++)
+	e->phases[i] = gc_last_phase_times[i];
+    e->nodes_freed = (double) nodes_before - (double) R_NodesInUse;
+    e->small_bytes_freed =
+	((double) small_before - (double) R_SmallVallocSize) * vsfac;
+    e->large_bytes_freed =
+	((double) large_before - (double) R_LargeVallocSize) * vsfac;
+    e->nsize = (double) R_NSize;
+    e->vsize = (double) R_VSize * vsfac;
+
+    if (gc_trace_file != NULL) {
+	fprintf(gc_trace_file,
+		"{\"gc\": %d, \"level\": %d, \"trigger\": \"%s\", "
+		"\"mark\": %.6f, \"sweep\": %.6f, \"adjust\": %.6f, "
+		"\"nodes.freed\": %.0f, \"small.bytes.freed\": %.0f, "
+		"\"large.bytes.freed\": %.0f, "
+		"\"nsize\": %.0f, \"vsize\": %.0f}\n",
+		e->count, e->level, gc_trigger_names[e->trigger],
+		e->phases[GC_PHASE_MARK], e->phases[GC_PHASE_SWEEP],
+		e->phases[GC_PHASE_ADJUST], e->nodes_freed,
+		e->small_bytes_freed, e->large_bytes_freed,
+		e->nsize, e->vsize);
+	fflush(gc_trace_file);
+    }
+}
+
 static void R_gc_internal(R_size_t size_needed)
 {
     R_CHECK_THREAD;
+    int request_trigger = gc_request_trigger;
+    gc_request_trigger = -1;
     if (!R_GCEnabled || R_in_gc) {
       if (R_in_gc)
         gc_error("*** recursive gc invocation\n");
       if (NO_FREE_NODES())
 	R_NSize = R_NodesInUse + 1;
 
-      if (num_old_gens_to_collect < NUM_OLD_GENERATIONS &&
+      if (num_old_gens_to_collect < num_old_generations &&
 	  VHEAP_FREE() < size_needed + R_MinFreeFrac * R_VSize)
 	num_old_gens_to_collect++;
 
@@ -3099,6 +3614,16 @@ static void R_gc_internal(R_size_t size_needed)
     }
     gc_pending = FALSE;
 
+    int trigger;
+    if (request_trigger >= 0)
+	trigger = request_trigger;
+    else if (NO_FREE_NODES())
+	trigger = GC_TRIGGER_CONS;
+    else if (VHEAP_FREE() < size_needed)
+	trigger = GC_TRIGGER_VECTOR;
+    else
+	trigger = GC_TRIGGER_FORCED;
+
     R_size_t onsize = R_NSize /* can change during collection */;
     double ncells, vcells, vfrac, nfrac;
     SEXPTYPE first_bad_sexp_type = 0;
@@ -3120,23 +3645,36 @@ static void R_gc_internal(R_size_t size_needed)
     R_V_maxused = R_MAX(R_V_maxused, R_VSize - VHEAP_FREE());
 
     BEGIN_SUSPEND_INTERRUPTS {
+	R_size_t nodes_before = R_NodesInUse;
+	R_size_t small_before = R_SmallVallocSize;
+	R_size_t large_before = R_LargeVallocSize;
 	R_in_gc = TRUE;
 	gc_start_timing();
 	gens_collected = RunGenCollect(size_needed);
 	gc_end_timing();
 	R_in_gc = FALSE;
+	RecordGCEvent(gens_collected, trigger, nodes_before,
+		      small_before, large_before);
     } END_SUSPEND_INTERRUPTS;
 
     if (R_check_constants > 2 ||
-	    (R_check_constants > 1 && gens_collected == NUM_OLD_GENERATIONS))
+	    (R_check_constants > 1 && gens_collected == num_old_generations))
 	R_checkConstants(TRUE);
 
     if (gc_reporting) {
 	REprintf("Garbage collection %d = %d", gc_count, gen_gc_counts[0]);
-	for (int i = 0; i < NUM_OLD_GENERATIONS; i++)
+	for (int i = 0; i < num_old_generations; i++)
 	    REprintf("+%d", gen_gc_counts[i + 1]);
 	REprintf(" (level %d) ... ", gens_collected);
-	DEBUG_GC_SUMMARY(gens_collected == NUM_OLD_GENERATIONS);
+	DEBUG_GC_SUMMARY(gens_collected == num_old_generations);
+    }
+
+    {
+	double pause = 0;
+	for (int i = 0; i < NUM_GC_PHASES; i++)
+	    pause += gc_last_phase_times[i];
+	if (pause > gc_max_pause)
+	    gc_max_pause = pause;
     }
 
     if (bad_sexp_type_seen != 0 && first_bad_sexp_type == 0) {
@@ -3160,6 +3698,18 @@ static void R_gc_internal(R_size_t size_needed)
 	vcells = 0.1*ceil(10*vcells * vsfac/Mega);
 	REprintf("%.1f Mbytes of vectors used (%d%%)\n",
 		 vcells, (int) (vfrac + 0.5));
+	if (R_LargePoolMax > 0)
+	    REprintf("Large vector pool: %.0f hits, %.0f misses, "
+		     "%.1f Mbytes cached\n",
+		     R_LargePoolHits, R_LargePoolMisses,
+		     0.1*ceil(10. * R_LargePoolSize/Mega));
+	REprintf("%.1f msecs: mark %.1f, sweep %.1f, adjust %.1f\n",
+		 1000 * (gc_last_phase_times[GC_PHASE_MARK] +
+			 gc_last_phase_times[GC_PHASE_SWEEP] +
+			 gc_last_phase_times[GC_PHASE_ADJUST]),
+		 1000 * gc_last_phase_times[GC_PHASE_MARK],
+		 1000 * gc_last_phase_times[GC_PHASE_SWEEP],
+		 1000 * gc_last_phase_times[GC_PHASE_ADJUST]);
     }
 
 #ifdef IMMEDIATE_FINALIZERS
@@ -4053,9 +4603,14 @@ SEXP (SET_VECTOR_ELT)(SEXP x, R_xlen_t i, SEXP v) {
     if (i < 0 || i >= XLENGTH(x))
 	error(_("attempt to set index %lld/%lld in SET_VECTOR_ELT"),
 	      (long long)i, (long long)XLENGTH(x));
-    FIX_REFCNT(x, VECTOR_ELT(x, i), v);
+    if (ALTREP(x)) {
+	ALTLIST_SET_ELT(x, i, v);
+	return v;
+    }
+    SEXP *ps = STDVEC_DATAPTR(x);
+    FIX_REFCNT(x, ps[i], v);
     CHECK_OLD_TO_NEW(x, v);
-    return VECTOR_ELT(x, i) = v;
+    return ps[i] = v;
 }
 
 /* check for a CONS-like object */
@@ -4421,6 +4976,11 @@ void (UNSET_NO_SPECIAL_SYMBOLS)(SEXP b) { UNSET_NO_SPECIAL_SYMBOLS(CHK(b)); }
 attribute_hidden
 Rboolean (NO_SPECIAL_SYMBOLS)(SEXP b) { return NO_SPECIAL_SYMBOLS(CHK(b)); }
 
+attribute_hidden
+void (SET_S3_METHOD_SYM)(SEXP b) { SET_S3_METHOD_SYM(CHK(b)); }
+attribute_hidden
+Rboolean (IS_S3_METHOD_SYM)(SEXP b) { return IS_S3_METHOD_SYM(CHK(b)); }
+
 /* R_FunTab accessors, only needed when write barrier is on */
 /* Not hidden to allow experimentaiton without rebuilding R - LT */
 /* attribute_hidden */
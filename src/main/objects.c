@@ -213,6 +213,102 @@ static SEXP findFunWithBaseEnvAfterGlobalEnv(SEXP symbol, SEXP rho)
     return (R_UnboundValue);
 }
 
+/* Cache of the part of S3 method lookup which does not depend on the
+   calling frames: the results of searching the S3 methods table of
+   the generic's defining environment and the enclosures of the
+   top-level environment of the call, keyed by (method, top, defrho).
+   Method symbols are marked when first cached; assigning or removing
+   a binding of a marked symbol, changing the search path or
+   reassigning the enclosure of an environment bumps
+   R_S3MethodCacheEpoch, which invalidates all entries.  Searches
+   involving user-defined databases are not cached.  The cache can be
+   disabled by setting _R_S3_METHOD_CACHE_ to a false value. */
+
+#define S3_METHOD_CACHE_SIZE 1024
+
+typedef struct {
+    SEXP method, top, defrho, val;
+    unsigned int epoch;
+} S3MethodCacheEntry;
+
+static S3MethodCacheEntry S3MethodCache[S3_METHOD_CACHE_SIZE];
+static SEXP S3MethodCacheProtect = NULL;  /* keeps top, defrho, val alive */
+static int S3MethodCacheEnabled = -1;
+static double S3MethodCacheHits = 0, S3MethodCacheMisses = 0;
+static unsigned int S3MethodCacheLastEpoch = 0;
+static double S3MethodCacheFlushes = 0;
+
+#define IS_USER_DATABASE(rho)  (OBJECT((rho)) && inherits((rho), "UserDefinedDatabase"))
+
+static R_INLINE int S3MethodCacheIndex(SEXP method, SEXP top, SEXP defrho)
+{
+    uintptr_t h = ((uintptr_t) method >> 4) ^ ((uintptr_t) top >> 3) ^
+	((uintptr_t) defrho >> 5);
+    return (int) (((uint64_t) h * 0x9E3779B97F4A7C15ULL) >> 54);
+}
+
+static void S3MethodCacheNoteEpoch(void)
+{
+    if (R_S3MethodCacheEpoch != S3MethodCacheLastEpoch) {
+	S3MethodCacheFlushes += R_S3MethodCacheEpoch - S3MethodCacheLastEpoch;
+	S3MethodCacheLastEpoch = R_S3MethodCacheEpoch;
+    }
+}
+
+/* Whether the result of looking up a method from 'top' can be cached:
+   user-defined databases may return anything at any time. */
+static Rboolean S3MethodCacheable(SEXP top)
+{
+    for (SEXP rho = top; rho != R_EmptyEnv; rho = ENCLOS(rho))
+	if (IS_USER_DATABASE(rho))
+	    return FALSE;
+    return TRUE;
+}
+
+static void S3MethodCacheStore(int i, SEXP method, SEXP top, SEXP defrho,
+			       SEXP val, unsigned int epoch)
+{
+    if (epoch != R_S3MethodCacheEpoch) /* invalidated during the lookup */
+	return;
+    if (S3MethodCacheProtect == NULL) {
+	S3MethodCacheProtect = allocVector(VECSXP, 3 * S3_METHOD_CACHE_SIZE);
+	R_PreserveObject(S3MethodCacheProtect);
+    }
+    S3MethodCacheEntry *ce = S3MethodCache + i;
+    ce->method = method;
+    ce->top = top;
+    ce->defrho = defrho;
+    ce->val = val;
+    ce->epoch = epoch;
+    SET_VECTOR_ELT(S3MethodCacheProtect, 3 * i, top);
+    SET_VECTOR_ELT(S3MethodCacheProtect, 3 * i + 1, defrho);
+    SET_VECTOR_ELT(S3MethodCacheProtect, 3 * i + 2, val);
+}
+
+/* .Internal(S3methodCacheStats(reset)) */
+attribute_hidden SEXP do_S3methodCacheStats(SEXP call, SEXP op, SEXP args,
+					    SEXP env)
+{
+    checkArity(op, args);
+    int reset = asLogical(CAR(args));
+    if (reset == NA_LOGICAL)
+	error(_("invalid '%s' argument"), "reset");
+    S3MethodCacheNoteEpoch();
+    SEXP ans = PROTECT(allocVector(REALSXP, 3));
+    SEXP nms = PROTECT(allocVector(STRSXP, 3));
+    REAL(ans)[0] = S3MethodCacheHits;
+    REAL(ans)[1] = S3MethodCacheMisses;
+    REAL(ans)[2] = S3MethodCacheFlushes;
+    SET_STRING_ELT(nms, 0, mkChar("hits"));
+    SET_STRING_ELT(nms, 1, mkChar("misses"));
+    SET_STRING_ELT(nms, 2, mkChar("invalidations"));
+    setAttrib(ans, R_NamesSymbol, nms);
+    if (reset)
+	S3MethodCacheHits = S3MethodCacheMisses = S3MethodCacheFlushes = 0;
+    UNPROTECT(2);
+    return ans;
+}
+
 /*  usemethod  -  calling functions need to evaluate the object
  *  (== 2nd argument).	They also need to ensure that the
  *  argument list is set up in the correct manner.
@@ -265,6 +361,11 @@ SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 	    ((lookup != NULL) && StringTrue(lookup)) ? 1 : 0;
     }
 
+    if(S3MethodCacheEnabled == -1) {
+	lookup = getenv("_R_S3_METHOD_CACHE_");
+	S3MethodCacheEnabled = ((lookup != NULL) && StringFalse(lookup)) ? 0 : 1;
+    }
+
     /* This evaluates promises */
     PROTECT(top = topenv(R_NilValue, callrho));
     val = findFunInEnvRange(method, callrho, top);
@@ -273,10 +374,35 @@ SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 	return val;
     }
 
-    PROTECT_WITH_INDEX(val, &validx);
     /* We assume here that no one registered a non-function */
-    if (!s_S3MethodsTable)
+    if (!s_S3MethodsTable) {
 	s_S3MethodsTable = install(".__S3MethodsTable__.");
+	SET_S3_METHOD_SYM(s_S3MethodsTable);
+    }
+
+    /* The rest of the search does not depend on callrho */
+    int ci = -1;
+    unsigned int epoch = 0;
+    if (S3MethodCacheEnabled && !lookup_report_search_path_uses) {
+	ci = S3MethodCacheIndex(method, top, defrho);
+	S3MethodCacheEntry *ce = S3MethodCache + ci;
+	if (ce->epoch == R_S3MethodCacheEpoch && ce->method == method &&
+	    ce->top == top && ce->defrho == defrho && ce->val != NULL) {
+	    S3MethodCacheHits++;
+	    UNPROTECT(1); /* top */
+	    return ce->val;
+	}
+	S3MethodCacheMisses++;
+	S3MethodCacheNoteEpoch();
+	if (S3MethodCacheable(top)) {
+	    SET_S3_METHOD_SYM(method);
+	    epoch = R_S3MethodCacheEpoch;
+	}
+	else ci = -1;
+    }
+    SEXP ctop = top;
+
+    PROTECT_WITH_INDEX(val, &validx);
     SEXP table = findVarInFrame3(defrho, s_S3MethodsTable, TRUE);
     if (TYPEOF(table) == PROMSXP) {
 	PROTECT(table);
@@ -290,6 +416,8 @@ SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 	if (TYPEOF(val) == PROMSXP) 
 	    REPROTECT(val = eval(val, rho), validx);
 	if(val != R_UnboundValue) {
+	    if (ci >= 0)
+		S3MethodCacheStore(ci, method, ctop, defrho, val, epoch);
 	    UNPROTECT(2); /* top, val */
 	    return val;
 	}
@@ -324,6 +452,8 @@ SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho)
 	REPROTECT(val = findFunInEnvRange(method, ENCLOS(top), R_EmptyEnv),
 	          validx);
 
+    if (ci >= 0)
+	S3MethodCacheStore(ci, method, ctop, defrho, val, epoch);
     UNPROTECT(2); /* top, val */
     return val;
 }
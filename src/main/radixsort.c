@@ -426,6 +426,113 @@ static void alloc_xtmp(int n)
     xtmp_alloc = n;
 }
 
+/*
+  The two passes over the whole of x at the top of iradix and dradix
+  (the histogram of all radixes and the scatter on the most significant
+  non-skipped radix) can be split across threads.  x is cut into one
+  contiguous chunk per thread; each chunk is counted separately, and
+  in the scatter chunk t writes its elements of bucket b after those of
+  chunks 0..t-1, so the result is the same stable ordering as the
+  serial pass.  The recursion into groups stays serial as it shares the
+  group stack and working memory.  The number of threads is taken from
+  getOption("sort.threads") by do_radixsort, limited like other math
+  threads to R_max_num_math_threads; inputs shorter than RADIX_PAR_MIN
+  are always done serially.
+*/
+#define RADIX_PAR_MIN 100000
+#define RADIX_MAX_THREADS 64
+static int radix_nthreads = 1;
+
+// per-chunk counts: radix_nthreads * 8 * 256
+static unsigned int *chunkcounts = NULL;
+static int chunkcounts_alloc = 0;
+
+static unsigned long long twiddle_key(void *x, int i, int nbytes);
+
+static R_INLINE Rboolean radix_parallel(int n)
+{
+#ifdef _OPENMP
+    return radix_nthreads > 1 && n >= RADIX_PAR_MIN;
+#else
+    return FALSE;
+#endif
+}
+
+/* Adds the counts of each byte of the keys of x into radixcounts and
+   returns the key of the last element. */
+static unsigned long long par_histogram(void *x, int n, int nbytes)
+{
+    int nchunks = radix_nthreads;
+    if (chunkcounts_alloc < nchunks) {
+	chunkcounts = (unsigned int *)
+	    realloc(chunkcounts, nchunks * 8 * 256 * sizeof(unsigned int));
+	if (chunkcounts == NULL)
+	    Error("Failed to allocate working memory for chunk counts");
+	chunkcounts_alloc = nchunks;
+    }
+    memset(chunkcounts, 0, nchunks * 8 * 256 * sizeof(unsigned int));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nchunks) schedule(static, 1)
+#endif
+    for (int t = 0; t < nchunks; t++) {
+	unsigned int *counts = chunkcounts + t * 8 * 256;
+	int from = (int) ((double) n * t / nchunks);
+	int to = (int) ((double) n * (t + 1) / nchunks);
+	for (int i = from; i < to; i++) {
+	    unsigned long long key = twiddle_key(x, i, nbytes);
+	    for (int radix = 0; radix < nbytes; radix++)
+		counts[radix * 256 + (key >> (radix * 8) & 0xFF)]++;
+	}
+    }
+
+    for (int t = 0; t < nchunks; t++)
+	for (int radix = 0; radix < nbytes; radix++)
+	    for (int b = 0; b < 256; b++)
+		radixcounts[radix][b] += chunkcounts[(t * 8 + radix) * 256 + b];
+    return twiddle_key(x, n - 1, nbytes);
+}
+
+/* Scatters the ordering of x by byte 'radix' of the keys into o, using
+   the chunk counts left by par_histogram.  thiscounts holds the
+   cumulated bucket ends as in iradix and is left holding the bucket
+   starts, as the serial scatter does. */
+static void par_scatter(void *x, int *o, int n, int nbytes, int radix,
+			unsigned int *thiscounts)
+{
+    int nchunks = radix_nthreads;
+    unsigned int start[256], prev = 0;
+
+    // bucket starts, and within them each chunk's starting position
+    // stored in place of its count
+    for (int b = 0; b < 256; b++) {
+	if (thiscounts[b] == 0) continue; // empty bucket, not cumulated
+	start[b] = prev;
+	unsigned int pos = prev;
+	for (int t = 0; t < nchunks; t++) {
+	    unsigned int *c = chunkcounts + (t * 8 + radix) * 256 + b;
+	    unsigned int cnt = *c;
+	    *c = pos;
+	    pos += cnt;
+	}
+	prev = thiscounts[b];
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nchunks) schedule(static, 1)
+#endif
+    for (int t = 0; t < nchunks; t++) {
+	unsigned int *pos = chunkcounts + (t * 8 + radix) * 256;
+	int from = (int) ((double) n * t / nchunks);
+	int to = (int) ((double) n * (t + 1) / nchunks);
+	for (int i = from; i < to; i++)
+	    o[pos[twiddle_key(x, i, nbytes) >> (radix * 8) & 0xFF]++] = i + 1;
+    }
+
+    for (int b = 0; b < 256; b++)
+	if (thiscounts[b]) thiscounts[b] = start[b];
+}
+
 static void iradix_r(int *xsub, int *osub, int n, int radix);
 
 static void iradix(int *x, int *o, int n)
@@ -437,6 +544,9 @@ static void iradix(int *x, int *o, int n)
     int nextradix, itmp, thisgrpn, maxgrpn;
     unsigned int thisx = 0, shift, *thiscounts;
 
+    if (radix_parallel(n))
+	thisx = (unsigned int) par_histogram(x, n, 4);
+    else
     for (int i = 0; i < n;i++) {
 	/* parallel histogramming pass; i.e. count occurrences of
 	   0:255 in each byte.  Sequential so almost negligible. */
@@ -493,6 +603,9 @@ static void iradix(int *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
+    if (radix_parallel(n))
+	par_scatter(x, o, n, 4, radix, thiscounts);
+    else
     for (int i = n - 1; i >= 0; i--) {
 	thisx = ((unsigned int) (icheck(x[i])) - INT_MIN) >> shift & 0xFF;
 	o[--thiscounts[thisx]] = i + 1;
@@ -626,14 +739,16 @@ static void setNumericRounding(int dround)
     dmask2 = 0xffffffffffffffff << dround * 8;
 }
 
-static union {
+typedef union {
     double d;
     unsigned long long ull;
-} u;
+} dull;
 
+// no static state, as it is called from several threads by par_scatter
 static
 unsigned long long dtwiddle(void *p, int i, int order)
 {
+    dull u;
     u.d = order * ((double *)p)[i]; // take care of 'order' at the beginning
     if (R_FINITE(u.d)) {
 	u.ull = (u.d != 0.0) ? u.ull + ((u.ull & dmask1) << 1) : 0;
@@ -650,6 +765,7 @@ unsigned long long dtwiddle(void *p, int i, int order)
 
 static Rboolean dnan(void *p, int i)
 {
+    dull u;
     u.d = ((double *) p)[i];
     return (ISNAN(u.d));
 }
@@ -660,6 +776,14 @@ static Rboolean(*is_nan) (void *, int);
 // merged in.
 static size_t colSize = 8;
 
+static unsigned long long twiddle_key(void *x, int i, int nbytes)
+{
+    // the keys iradix and dradix sort on
+    return nbytes == 4 ?
+	(unsigned int) (icheck(((int *) x)[i])) - INT_MIN :
+	twiddle(x, i, order);
+}
+
 static void dradix_r(unsigned char *xsub, int *osub, int n, int radix);
 
 #ifdef WORDS_BIGENDIAN
@@ -675,6 +799,9 @@ static void dradix(unsigned char *x, int *o, int n)
     unsigned long long thisx = 0;
     // see comments in iradix for structure.  This follows the same.
     // TO DO: merge iradix in here (almost ready)
+    if (radix_parallel(n))
+	thisx = par_histogram(x, n, (int) colSize);
+    else
     for (int i = 0; i < n; i++) {
 	thisx = twiddle(x, i, order);
 	for (radix = 0; radix < colSize; radix++)
@@ -723,6 +850,9 @@ static void dradix(unsigned char *x, int *o, int n)
 	    thiscounts[i] = (itmp += thisgrpn);
 	}
     }
+    if (radix_parallel(n))
+	par_scatter(x, o, n, (int) colSize, radix, thiscounts);
+    else
     for (int i = n - 1; i >= 0; i--) {
 	thisx = twiddle(x, i, order);
 	o[ --thiscounts[((unsigned char *)&thisx)[RADIX_BYTE]] ] = i + 1;
@@ -1598,6 +1728,17 @@ SEXP attribute_hidden do_radixsort(SEXP call, SEXP op, SEXP args, SEXP rho)
     }
     order = asLogical(decreasing) ? -1 : 1;
 
+    radix_nthreads = 1;
+#ifdef _OPENMP
+    {
+	int nth = asInteger(GetOption1(install("sort.threads")));
+	if (nth > R_max_num_math_threads)
+	    nth = R_max_num_math_threads;
+	if (nth != NA_INTEGER && nth > 1)
+	    radix_nthreads = nth > RADIX_MAX_THREADS ? RADIX_MAX_THREADS : nth;
+    }
+#endif
+
     SEXP x = CAR(args);
     args = CDR(args);
 
@@ -1910,6 +2051,7 @@ SEXP attribute_hidden do_radixsort(SEXP call, SEXP op, SEXP args, SEXP rho)
     free(xtmp);                xtmp=NULL;          xtmp_alloc=0;
     free(otmp);                otmp=NULL;          otmp_alloc=0;
     free(csort_otmp);          csort_otmp=NULL;    csort_otmp_alloc=0;
+    free(chunkcounts);         chunkcounts=NULL;   chunkcounts_alloc=0;
 
     free(cradix_counts);       cradix_counts=NULL; cradix_counts_alloc=0;
     free(cradix_xtmp);         cradix_xtmp=NULL;   cradix_xtmp_alloc=0;
@@ -33,6 +33,7 @@
 #include <R_ext/RS.h>           /* for CallocCharBuf, Free */
 #include <errno.h>
 #include <ctype.h>		/* for isspace */
+#include <stdint.h>		/* for uint32_t, uint64_t */
 #include <stdarg.h>
 #ifdef Win32
 #include <trioremap.h>
@@ -178,6 +179,18 @@
    Version 3 also adds support for custom ALTREP serialization. Under
    version 2 ALTREP objects are serialied like non-ALTREP ones. */
 
+/* The aligned binary format, written by saveRDS(xdr = FALSE), is the
+   native binary format with the contents of large logical, integer,
+   double and raw vectors starting at a multiple of 8 bytes from the
+   start of the stream, so readRDS(mmap = TRUE) can use them in place
+   in a memory-mapped file.  The header is "b\n" rather than "B\n" so
+   older versions of R reject such streams.  Aligned items have
+   IS_ALIGNED_BIT_MASK set in their flags, and their length is followed
+   by a byte giving the number of zero padding bytes which follow it.
+   Readers only need the flag, not the position in the stream, so the
+   format can also be read from any connection.  Streams writing it
+   have 'aligned' set and those reading a mapped file 'mapped'. */
+
 /*
  * Forward Declarations
  */
@@ -187,6 +200,8 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream);
 static SEXP ReadItem(SEXP ref_table, R_inpstream_t stream);
 static void WriteBC(SEXP s, SEXP ref_table, R_outpstream_t stream);
 static SEXP ReadBC(SEXP ref_table, R_inpstream_t stream);
+static SEXP InAlignedView(R_inpstream_t stream, int flags,
+			  SEXPTYPE type, R_xlen_t len);
 
 /*
  * Constants
@@ -578,7 +593,12 @@ static void OutFormat(R_outpstream_t stream)
 	stream->OutBytes(stream, "A\n", 2); break;
 	/* on deserialization, asciihex_format is treated exactly the same
 	   way as ascii_format; the distinction is handled inside scanf %lg */
-    case R_pstream_binary_format: stream->OutBytes(stream, "B\n", 2); break;
+    case R_pstream_binary_format:
+	if (stream->aligned)
+	    stream->OutBytes(stream, "b\n", 2);
+	else
+	    stream->OutBytes(stream, "B\n", 2);
+	break;
     case R_pstream_xdr_format:    stream->OutBytes(stream, "X\n", 2); break;
     case R_pstream_any_format:
 	error(_("must specify ascii, binary, or xdr format"));
@@ -594,6 +614,7 @@ static void InFormat(R_inpstream_t stream)
     switch (buf[0]) {
     case 'A': type = R_pstream_ascii_format; break; /* also for asciihex */
     case 'B': type = R_pstream_binary_format; break;
+    case 'b': type = R_pstream_binary_format; break; /* aligned */
     case 'X': type = R_pstream_xdr_format; break;
     case '\n':
 	/* GROSS HACK: ASCII unserialize may leave a trailing newline
@@ -732,6 +753,7 @@ static int HashGet(SEXP item, SEXP ht)
 #define IS_OBJECT_BIT_MASK (1 << 8)
 #define HAS_ATTR_BIT_MASK (1 << 9)
 #define HAS_TAG_BIT_MASK (1 << 10)
+#define IS_ALIGNED_BIT_MASK (1 << 11)
 #define ENCODE_LEVELS(v) ((v) << 12)
 #define DECODE_LEVELS(v) ((v) >> 12)
 #define DECODE_TYPE(v) ((v) & 255)
@@ -852,6 +874,36 @@ static int SaveSpecialHook(SEXP item)
     return 0;
 }
 
+/* Contents of at least this many bytes are aligned in the aligned
+   binary format */
+#define ALIGN_MIN_BYTES 4096
+
+typedef struct alignconn_st {
+    struct Rconn *con;
+    R_size_t count;
+} *alignconn_t;
+
+static Rboolean AlignContents(R_outpstream_t stream, SEXP s)
+{
+    if (! stream->aligned)
+	return FALSE;
+    switch (TYPEOF(s)) {
+    case LGLSXP:
+    case INTSXP: return XLENGTH(s) >= ALIGN_MIN_BYTES / sizeof(int);
+    case REALSXP: return XLENGTH(s) >= ALIGN_MIN_BYTES / sizeof(double);
+    case RAWSXP: return XLENGTH(s) >= ALIGN_MIN_BYTES;
+    default: return FALSE;
+    }
+}
+
+static void OutAlign(R_outpstream_t stream)
+{
+    alignconn_t ac = stream->data;
+    char pad[8] = {0};
+    pad[0] = (char) ((8 - (ac->count + 1) % 8) % 8);
+    stream->OutBytes(stream, pad, 1 + pad[0]);
+}
+
 static void WriteLENGTH(R_outpstream_t stream, SEXP s)
 {
 #ifdef LONG_VECTOR_SUPPORT
@@ -890,6 +942,81 @@ static void OutStringVec(R_outpstream_t stream, SEXP s, SEXP ref_table)
 
 #define min2(a, b) ((a) < (b)) ? (a) : (b)
 
+/* XDR represents integers and doubles as big-endian IEEE values, so
+   on the platforms R runs on converting a vector is a copy or a byte
+   swap of each element.  Done as a simple loop, which compilers can
+   vectorize, this is much faster than calling xdr_int() or
+   xdr_double() for each element.  The first use checks that it gives
+   the same bytes as the XDR routines, which are used otherwise. */
+
+#ifdef __GNUC__
+# define XDR_BSWAP32 __builtin_bswap32
+# define XDR_BSWAP64 __builtin_bswap64
+#else
+static R_INLINE uint32_t XDR_BSWAP32(uint32_t x)
+{
+    return (x << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+static R_INLINE uint64_t XDR_BSWAP64(uint64_t x)
+{
+    return ((uint64_t) XDR_BSWAP32((uint32_t) x) << 32) |
+	XDR_BSWAP32((uint32_t) (x >> 32));
+}
+#endif
+
+/* copy n 4-byte (size 4) or 8-byte (size 8) values between native
+   and XDR byte order; 'to' and 'from' may be the same */
+static void XDRCopyVec(void *to, const void *from, R_xlen_t n, int size)
+{
+#ifdef WORDS_BIGENDIAN
+    if (to != from) memmove(to, from, n * size);
+#else
+    unsigned char *t = (unsigned char *) to;
+    const unsigned char *f = (const unsigned char *) from;
+    if (size == 4)
+	for (R_xlen_t i = 0; i < n; i++) {
+	    uint32_t v;
+	    memcpy(&v, f + 4 * i, 4);
+	    v = XDR_BSWAP32(v);
+	    memcpy(t + 4 * i, &v, 4);
+	}
+    else
+	for (R_xlen_t i = 0; i < n; i++) {
+	    uint64_t v;
+	    memcpy(&v, f + 8 * i, 8);
+	    v = XDR_BSWAP64(v);
+	    memcpy(t + 8 * i, &v, 8);
+	}
+#endif
+}
+
+static Rboolean XDRCopyOK(void)
+{
+    static int ok = -1;
+    if (ok < 0) {
+	int i[2] = { 0x01020304, NA_INTEGER };
+	double d[2] = { -1.5e-300, NA_REAL };
+	char xbuf[2 * sizeof(double)], cbuf[2 * sizeof(double)];
+	XDR xdrs;
+	Rboolean same = TRUE;
+
+	xdrmem_create(&xdrs, xbuf, (int) sizeof(i), XDR_ENCODE);
+	if (!xdr_int(&xdrs, i) || !xdr_int(&xdrs, i + 1)) same = FALSE;
+	xdr_destroy(&xdrs);
+	XDRCopyVec(cbuf, i, 2, sizeof(int));
+	if (memcmp(xbuf, cbuf, sizeof(i))) same = FALSE;
+
+	xdrmem_create(&xdrs, xbuf, (int) sizeof(d), XDR_ENCODE);
+	if (!xdr_double(&xdrs, d) || !xdr_double(&xdrs, d + 1)) same = FALSE;
+	xdr_destroy(&xdrs);
+	XDRCopyVec(cbuf, d, 2, sizeof(double));
+	if (memcmp(xbuf, cbuf, sizeof(d))) same = FALSE;
+
+	ok = same && sizeof(int) == 4 && sizeof(double) == 8;
+    }
+    return ok;
+}
+
 
 static R_INLINE void
 OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
@@ -900,13 +1027,19 @@ OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	static char buf[CHUNK_SIZE * sizeof(int)];
 	R_xlen_t done, this;
 	XDR xdrs;
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(int)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++)
-		if(!xdr_int(&xdrs, INTEGER(s) + done + cnt))
-		    error(_("XDR write failed"));
-	    xdr_destroy(&xdrs);
+	    if (copy)
+		XDRCopyVec(buf, INTEGER(s) + done, this, sizeof(int));
+	    else {
+		xdrmem_create(&xdrs, buf, (int)(this * sizeof(int)),
+			      XDR_ENCODE);
+		for(int cnt = 0; cnt < this; cnt++)
+		    if(!xdr_int(&xdrs, INTEGER(s) + done + cnt))
+			error(_("XDR write failed"));
+		xdr_destroy(&xdrs);
+	    }
 	    stream->OutBytes(stream, buf, (int)(sizeof(int) * this));
 	}
 	break;
@@ -937,13 +1070,19 @@ OutRealVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	static char buf[CHUNK_SIZE * sizeof(double)];
 	R_xlen_t done, this;
 	XDR xdrs;
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(double)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++)
-		if(!xdr_double(&xdrs, REAL(s) + done + cnt))
-		    error(_("XDR write failed"));
-	    xdr_destroy(&xdrs);
+	    if (copy)
+		XDRCopyVec(buf, REAL(s) + done, this, sizeof(double));
+	    else {
+		xdrmem_create(&xdrs, buf, (int)(this * sizeof(double)),
+			      XDR_ENCODE);
+		for(int cnt = 0; cnt < this; cnt++)
+		    if(!xdr_double(&xdrs, REAL(s) + done + cnt))
+			error(_("XDR write failed"));
+		xdr_destroy(&xdrs);
+	    }
 	    stream->OutBytes(stream, buf, (int)(sizeof(double) * this));
 	}
 	break;
@@ -974,16 +1113,22 @@ OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	R_xlen_t done, this;
 	XDR xdrs;
 	Rcomplex *c = COMPLEX(s);
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
-	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(Rcomplex)), XDR_ENCODE);
-	    for(int cnt = 0; cnt < this; cnt++) {
-		if(!xdr_double(&xdrs, &(c[done+cnt].r)) ||
-		   !xdr_double(&xdrs, &(c[done+cnt].i)))
-		    error(_("XDR write failed"));
+	    if (copy)
+		XDRCopyVec(buf, c + done, 2 * this, sizeof(double));
+	    else {
+		xdrmem_create(&xdrs, buf, (int)(this * sizeof(Rcomplex)),
+			      XDR_ENCODE);
+		for(int cnt = 0; cnt < this; cnt++) {
+		    if(!xdr_double(&xdrs, &(c[done+cnt].r)) ||
+		       !xdr_double(&xdrs, &(c[done+cnt].i)))
+			error(_("XDR write failed"));
+		}
+		xdr_destroy(&xdrs);
 	    }
 	    stream->OutBytes(stream, buf, (int)(sizeof(Rcomplex) * this));
-	    xdr_destroy(&xdrs);
 	}
 	break;
     }
@@ -1113,6 +1258,8 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	hasattr = (TYPEOF(s) != CHARSXP && ATTRIB(s) != R_NilValue);
 	flags = PackFlags(TYPEOF(s), LEVELS(s), OBJECT(s),
 			  hasattr, hastag);
+	if (AlignContents(stream, s))
+	    flags |= IS_ALIGNED_BIT_MASK;
 	OutInteger(stream, flags);
 	switch (TYPEOF(s)) {
 	case LISTSXP:
@@ -1161,11 +1308,13 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case INTSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    if (flags & IS_ALIGNED_BIT_MASK) OutAlign(stream);
 	    OutIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    if (flags & IS_ALIGNED_BIT_MASK) OutAlign(stream);
 	    OutRealVec(stream, s, len);
 	    break;
 	case CPLXSXP:
@@ -1192,6 +1341,7 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case RAWSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    if (flags & IS_ALIGNED_BIT_MASK) OutAlign(stream);
 	    switch (stream->type) {
 	    case R_pstream_xdr_format:
 	    case R_pstream_binary_format:
@@ -1482,8 +1632,16 @@ InIntegerVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	static char buf[CHUNK_SIZE * sizeof(int)];
 	R_xlen_t done, this;
 	XDR xdrs;
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
+	    if (copy) {
+		/* read straight into the vector and convert in place */
+		int *p = INTEGER(obj) + done;
+		stream->InBytes(stream, p, (int)(sizeof(int) * this));
+		XDRCopyVec(p, p, this, sizeof(int));
+		continue;
+	    }
 	    stream->InBytes(stream, buf, (int)(sizeof(int) * this));
 	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(int)), XDR_DECODE);
 	    for(int cnt = 0; cnt < this; cnt++)
@@ -1518,8 +1676,15 @@ InRealVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	static char buf[CHUNK_SIZE * sizeof(double)];
 	R_xlen_t done, this;
 	XDR xdrs;
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
+	    if (copy) {
+		double *p = REAL(obj) + done;
+		stream->InBytes(stream, p, (int)(sizeof(double) * this));
+		XDRCopyVec(p, p, this, sizeof(double));
+		continue;
+	    }
 	    stream->InBytes(stream, buf, (int)(sizeof(double) * this));
 	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(double)), XDR_DECODE);
 	    for(R_xlen_t cnt = 0; cnt < this; cnt++)
@@ -1555,8 +1720,15 @@ InComplexVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	R_xlen_t done, this;
 	XDR xdrs;
 	Rcomplex *output = COMPLEX(obj);
+	Rboolean copy = XDRCopyOK();
 	for (done = 0; done < length; done += this) {
 	    this = min2(CHUNK_SIZE, length - done);
+	    if (copy) {
+		Rcomplex *p = output + done;
+		stream->InBytes(stream, p, (int)(sizeof(Rcomplex) * this));
+		XDRCopyVec(p, p, 2 * this, sizeof(double));
+		continue;
+	    }
 	    stream->InBytes(stream, buf, (int)(sizeof(Rcomplex) * this));
 	    xdrmem_create(&xdrs, buf, (int)(this * sizeof(Rcomplex)), XDR_DECODE);
 	    for(R_xlen_t cnt = 0; cnt < this; cnt++) {
@@ -1714,6 +1886,16 @@ ReadChar(R_inpstream_t stream, char *buf, int length, int levs)
     return mkCharLenCE(buf, length, CE_NATIVE); 
 }
 
+static void InAlign(R_inpstream_t stream)
+{
+    unsigned char pad[8];
+    stream->InBytes(stream, pad, 1);
+    if (pad[0] > 7)
+	error(_("invalid alignment padding"));
+    if (pad[0] > 0)
+	stream->InBytes(stream, pad + 1, pad[0]);
+}
+
 static R_xlen_t ReadLENGTH (R_inpstream_t stream)
 {
     int len = InInteger(stream);
@@ -1930,11 +2112,19 @@ static SEXP ReadItem (SEXP ref_table, R_inpstream_t stream)
 	case LGLSXP:
 	case INTSXP:
 	    len = ReadLENGTH(stream);
+	    if ((s = InAlignedView(stream, flags, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = ReadLENGTH(stream);
+	    if ((s = InAlignedView(stream, flags, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InRealVec(stream, s, len);
 	    break;
@@ -1972,6 +2162,10 @@ static SEXP ReadItem (SEXP ref_table, R_inpstream_t stream)
 	    error(_("this version of R cannot read generic function references"));
 	case RAWSXP:
 	    len = ReadLENGTH(stream);
+	    if ((s = InAlignedView(stream, flags, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    switch (stream->type) {
 	    case R_pstream_ascii_format:
@@ -2280,6 +2474,7 @@ R_InitInPStream(R_inpstream_t stream, R_pstream_data_t data,
     stream->native_encoding[0] = 0;
     stream->nat2nat_obj = NULL;
     stream->nat2utf8_obj = NULL; 
+    stream->mapped = FALSE;
 }
 
 void
@@ -2296,6 +2491,7 @@ R_InitOutPStream(R_outpstream_t stream, R_pstream_data_t data,
     stream->OutBytes = outbytes;
     stream->OutPersistHookFunc = phook;
     stream->OutPersistHookData = pdata;
+    stream->aligned = FALSE;
 }
 
 
@@ -2446,6 +2642,23 @@ static void OutCharConn(R_outpstream_t stream, int c)
     }
 }
 
+/* Connection streams for the aligned binary format, which count the
+   bytes written */
+static void OutBytesAligned(R_outpstream_t stream, void *buf, int length)
+{
+    alignconn_t ac = stream->data;
+    if (length != ac->con->write(buf, 1, length, ac->con))
+	error(_("error writing to connection"));
+    ac->count += length;
+}
+
+static void OutCharAligned(R_outpstream_t stream, int c)
+{
+    char buf[1];
+    buf[0] = (char) c;
+    OutBytesAligned(stream, buf, 1);
+}
+
 void R_InitConnOutPStream(R_outpstream_t stream, Rconnection con,
 			  R_pstream_format_t type, int version,
 			  SEXP (*phook)(SEXP, SEXP), SEXP pdata)
@@ -2495,13 +2708,14 @@ static void con_cleanup(void *data)
 SEXP attribute_hidden
 do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    /* serializeToConn(object, conn, ascii, version, hook) */
+    /* serializeToConn(object, conn, ascii, version, hook, xdr) */
 
     SEXP object, fun;
     Rboolean ascii, wasopen;
     int version;
     Rconnection con;
     struct R_outpstream_st out;
+    struct alignconn_st ac;
     R_pstream_format_t type;
     SEXP (*hook)(SEXP, SEXP);
     RCNTXT cntxt;
@@ -2516,6 +2730,8 @@ do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
     ascii = INTEGER(CADDR(args))[0];
     if (ascii == NA_LOGICAL) type = R_pstream_asciihex_format;
     else if (ascii) type = R_pstream_ascii_format;
+    else if (asLogical(CAR(nthcdr(args, 5))) == FALSE)
+	type = R_pstream_binary_format; /* aligned */
     else type = R_pstream_xdr_format;
 
     if (CADDDR(args) == R_NilValue)
@@ -2537,6 +2753,8 @@ do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
     wasopen = con->isopen;
     if(!wasopen) {
 	char mode[5];
+	/* the connection may be to the file of a lazy list */
+	R_force_lazy_lists(object);
 	strcpy(mode, con->mode);
 	strcpy(con->mode, ascii ? "w" : "wb");
 	if(!con->open(con)) error(_("cannot open the connection"));
@@ -2552,7 +2770,16 @@ do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
     if(!con->canwrite)
 	error(_("connection not open for writing"));
 
-    R_InitConnOutPStream(&out, con, type, version, hook, fun);
+    if (type == R_pstream_binary_format) {
+	CheckOutConn(con);
+	ac.con = con;
+	ac.count = 0;
+	R_InitOutPStream(&out, (R_pstream_data_t) &ac, type, version,
+			 OutCharAligned, OutBytesAligned, hook, fun);
+	out.aligned = TRUE;
+    }
+    else
+	R_InitConnOutPStream(&out, con, type, version, hook, fun);
     R_Serialize(object, &out);
     if(!wasopen) {endcontext(&cntxt); con->close(con);}
 
@@ -2816,6 +3043,68 @@ static SEXP CloseMemOutPStream(R_outpstream_t stream)
     return val;
 }
 
+/*
+ * Memory-Mapped Input Streams
+ */
+
+/* A memory stream reading a file mapped by R_mmap_region, so aligned
+   items can be returned as views of the mapping */
+typedef struct mmapbuf_st {
+    struct membuf_st mb; /* must be first: the stream is also a membuf */
+    SEXP region;
+} *mmapbuf_t;
+
+/* Read the padding of an aligned item; when reading from a mapped file
+   return a view of its contents, or NULL if they have to be copied */
+static SEXP InAlignedView(R_inpstream_t stream, int flags,
+			  SEXPTYPE type, R_xlen_t len)
+{
+    if (! (flags & IS_ALIGNED_BIT_MASK))
+	return NULL;
+    InAlign(stream);
+    if (! stream->mapped)
+	return NULL;
+
+    mmapbuf_t mm = stream->data;
+    R_size_t offset = mm->mb.count;
+    size_t size = type == REALSXP ? sizeof(double) :
+	(type == RAWSXP ? 1 : sizeof(int));
+    if ((uintptr_t) (mm->mb.buf + offset) % size != 0)
+	return NULL;
+    if ((R_size_t) len > (mm->mb.size - offset) / size)
+	error(_("read error"));
+    mm->mb.count += (R_size_t) len * size;
+    return R_mmap_view(mm->region, type, offset, len);
+}
+
+/* unserializeFromMmap(file, hook), used from readRDS(mmap = TRUE) */
+SEXP attribute_hidden
+do_unserializeFromMmap(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    struct R_inpstream_st in;
+    struct mmapbuf_st mbs;
+    R_size_t size;
+    SEXP file, fun, ans;
+    SEXP (*hook)(SEXP, SEXP);
+
+    checkArity(op, args);
+
+    file = CAR(args);
+    if (!isString(file) || LENGTH(file) != 1 ||
+	STRING_ELT(file, 0) == NA_STRING)
+	error(_("invalid '%s' argument"), "file");
+    fun = CADR(args);
+    hook = fun != R_NilValue ? CallHook : NULL;
+
+    PROTECT(mbs.region = R_mmap_region(file, &size));
+    InitMemInPStream(&in, &mbs.mb, R_ExternalPtrAddr(mbs.region), size,
+		     hook, fun);
+    in.mapped = TRUE;
+    ans = R_Unserialize(&in);
+    UNPROTECT(1); /* mbs.region */
+    return ans;
+}
+
 static SEXP
 R_serialize(SEXP object, SEXP icon, SEXP ascii, SEXP Sversion, SEXP fun)
 {
@@ -2960,11 +3249,130 @@ static SEXP appendRawToFile(SEXP file, SEXP bytes)
 
 /* Interface to cache the pkg.rdb files */
 
+/* Up to NC files are cached whole, the least recently used being
+   dropped when the cache is full.  Where mmap is available a file is
+   mapped read-only whatever its size, so a value is copied from the
+   page cache and the pages are shared by all the processes using the
+   file, including children forked by parallel::mcfork.  Otherwise
+   only files of less than LEN_LIMIT bytes are cached, by reading them
+   into memory.  Values from files which are not cached are read from
+   the file each time.
+
+   Accessing the pages of a mapping beyond the end of a file which
+   has been truncated is fatal, so before each access the file is
+   checked to be the one mapped, with the same size and modification
+   time, and is mapped again if not.  This is not atomic, but makes a
+   file being rewritten (e.g. by reinstalling a package) while it is
+   cached no worse than it was with in-memory copies. */
+
 #define NC 100
 static int used = 0;
 static char names[NC][PATH_MAX];
 static char *ptr[NC];
+static size_t lens[NC];
+static unsigned long stamps[NC], stamp = 0;
+
+/* There are some large lazy-data examples, e.g. 80Mb for SNPMaP.cdm */
+#define LEN_LIMIT 10*1048576
+
+#include <sys/stat.h>
+#if defined HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC
+# define MTIME_NS(sb) ((long) (sb).st_mtim.tv_nsec)
+#elif defined HAVE_STRUCT_STAT_ST_ATIMESPEC_TV_NSEC
+# define MTIME_NS(sb) ((long) (sb).st_mtimespec.tv_nsec)
+#else
+# define MTIME_NS(sb) 0L
+#endif
+
+#ifdef HAVE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+
+static struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    long mtime_ns;
+} ids[NC];
+
+static void setFileId(int i, struct stat *sb)
+{
+    ids[i].dev = sb->st_dev;
+    ids[i].ino = sb->st_ino;
+    ids[i].size = sb->st_size;
+    ids[i].mtime = sb->st_mtime;
+    ids[i].mtime_ns = MTIME_NS(*sb);
+}
+
+/* Is cfile no longer the file cached in slot i? */
+static Rboolean fileChanged(const char *cfile, int i)
+{
+    struct stat sb;
+    return stat(cfile, &sb) != 0 ||
+	sb.st_dev != ids[i].dev || sb.st_ino != ids[i].ino ||
+	sb.st_size != ids[i].size || sb.st_mtime != ids[i].mtime ||
+	MTIME_NS(sb) != ids[i].mtime_ns;
+}
+#else
+# define fileChanged(cfile, i) FALSE
+#endif
+
+/* Caches a file in slot i, returning FALSE if it cannot be cached. */
+static Rboolean cacheFile(const char *cfile, int i)
+{
+#ifdef HAVE_MMAP
+    struct stat sb;
+    int fd = open(cfile, O_RDONLY);
+    if (fd == -1) return FALSE;
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size <= 0 ||
+	(uintmax_t) sb.st_size > SIZE_MAX) {
+	close(fd);
+	return FALSE;
+    }
+    void *p = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* the mapping stays valid */
+    if (p == MAP_FAILED) return FALSE;
+    setFileId(i, &sb);
+    lens[i] = (size_t) sb.st_size;
+#else
+    FILE *fp;
+    long filelen;
+    char *p;
+
+    if ((fp = R_fopen(cfile, "rb")) == NULL)
+	return FALSE;
+    if (fseek(fp, 0, SEEK_END) != 0 || (filelen = ftell(fp)) <= 0 ||
+	filelen >= LEN_LIMIT || fseek(fp, 0, SEEK_SET) != 0 ||
+	(p = (char *) malloc(filelen)) == NULL) {
+	fclose(fp);
+	return FALSE;
+    }
+    if (fread(p, 1, filelen, fp) != (size_t) filelen) {
+	fclose(fp);
+	free(p);
+	return FALSE;
+    }
+    fclose(fp);
+    lens[i] = (size_t) filelen;
+#endif
+    ptr[i] = p;
+    strcpy(names[i], cfile);
+    return TRUE;
+}
+
+static void uncacheFile(int i)
+{
+#ifdef HAVE_MMAP
+    munmap(ptr[i], lens[i]);
+#else
+    free(ptr[i]);
+#endif
+    strcpy(names[i], "");
+}
 
+/* Returns whether the file was cached */
 SEXP attribute_hidden
 do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
 {
@@ -2975,27 +3383,23 @@ do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
 
     /* fprintf(stderr, "flushing file %s", cfile); */
     for (i = 0; i < used; i++)
-	if(strcmp(cfile, names[i]) == 0) {
-	    strcpy(names[i], "");
-	    free(ptr[i]);
+	if(names[i][0] && strcmp(cfile, names[i]) == 0) {
+	    uncacheFile(i);
 	    /* fprintf(stderr, " found at pos %d in cache", i); */
-	    break;
+	    return ScalarLogical(TRUE);
 	}
     /* fprintf(stderr, "\n"); */
-    return R_NilValue;
+    return ScalarLogical(FALSE);
 }
 
 
 /* Reads, in binary mode, the bytes in the range specified by a
    position/length vector and returns them as raw vector. */
 
-/* There are some large lazy-data examples, e.g. 80Mb for SNPMaP.cdm */
-#define LEN_LIMIT 10*1048576
 static SEXP readRawFromFile(SEXP file, SEXP key)
 {
     FILE *fp;
     int offset, len, in, i, icache = -1;
-    long filelen;
     SEXP val;
     const void *vmax;
     const char *cfile;
@@ -3009,69 +3413,45 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 
     offset = INTEGER(key)[0];
     len = INTEGER(key)[1];
+    if (offset < 0 || len < 0)
+	error(_("bad offset/length argument"));
 
     val = allocVector(RAWSXP, len);
     /* Do we have this database cached? */
     for (i = 0; i < used; i++)
-	if(strcmp(cfile, names[i]) == 0) {icache = i; break;}
-    if (icache >= 0) {
-	memcpy(RAW(val), ptr[icache]+offset, len);
-	vmaxset(vmax);
-	return val;
-    }
-
-    /* find a vacant slot? */
-    for (i = 0; i < used; i++)
-	if(strcmp("", names[i]) == 0) {icache = i; break;}
-    if(icache < 0 && used < NC) icache = used++;
-
-    if(icache >= 0) {
-	if ((fp = R_fopen(cfile, "rb")) == NULL)
-	    error(_("cannot open file '%s': %s"), cfile, strerror(errno));
-	if (fseek(fp, 0, SEEK_END) != 0) {
-	    fclose(fp);
-	    error(_("seek failed on %s"), cfile);
-	}
-	filelen = ftell(fp);
-	if (filelen < LEN_LIMIT) {
-	    char *p;
-	    /* fprintf(stderr, "adding file '%s' at pos %d in cache, length %d\n",
-	       cfile, icache, filelen); */
-	    p = (char *) malloc(filelen);
-	    if (p) {
-		strcpy(names[icache], cfile);
-		ptr[icache] = p;
-		if (fseek(fp, 0, SEEK_SET) != 0) {
-		    fclose(fp);
-		    error(_("seek failed on %s"), cfile);
-		}
-		in = (int) fread(p, 1, filelen, fp);
-		fclose(fp);
-		if (filelen != in) error(_("read failed on %s"), cfile);
-		memcpy(RAW(val), p+offset, len);
-	    } else {
-		if (fseek(fp, offset, SEEK_SET) != 0) {
-		    fclose(fp);
-		    error(_("seek failed on %s"), cfile);
-		}
-		in = (int) fread(RAW(val), 1, len, fp);
-		fclose(fp);
-		if (len != in) error(_("read failed on %s"), cfile);
-	    }
-	    vmaxset(vmax);
-	    return val;
-	} else {
-	    if (fseek(fp, offset, SEEK_SET) != 0) {
-		fclose(fp);
-		error(_("seek failed on %s"), cfile);
+	if(names[i][0] && strcmp(cfile, names[i]) == 0) {icache = i; break;}
+
+    /* a file which has changed or grown since it was cached is
+       cached again */
+    if (icache >= 0 &&
+	(fileChanged(cfile, icache) || (size_t) offset + len > lens[icache]))
+	uncacheFile(icache);
+    else if (icache < 0 && strlen(cfile) < PATH_MAX) {
+	/* find a vacant slot, or drop the least recently used file */
+	for (i = 0; i < used; i++)
+	    if(names[i][0] == '\0') {icache = i; break;}
+	if (icache < 0) {
+	    if (used < NC)
+		icache = used++;
+	    else {
+		for (icache = 0, i = 1; i < used; i++)
+		    if (stamps[i] < stamps[icache]) icache = i;
+		uncacheFile(icache);
 	    }
-	    in = (int) fread(RAW(val), 1, len, fp);
-	    fclose(fp);
-	    if (len != in) error(_("read failed on %s"), cfile);
-	    vmaxset(vmax);
-	    return val;
 	}
     }
+    if (icache >= 0 && names[icache][0] == '\0') {
+	/* fprintf(stderr, "adding file '%s' at pos %d in cache\n",
+	   cfile, icache); */
+	if (!cacheFile(cfile, icache)) icache = -1;
+    }
+
+    if (icache >= 0 && (size_t) offset + len <= lens[icache]) {
+	stamps[icache] = ++stamp;
+	memcpy(RAW(val), ptr[icache] + offset, len);
+	vmaxset(vmax);
+	return val;
+    }
 
     if ((fp = R_fopen(cfile, "rb")) == NULL)
 	error(_("cannot open file '%s': %s"), cfile, strerror(errno));
@@ -3225,6 +3605,293 @@ do_lazyLoadDBinsertValue(SEXP call, SEXP op, SEXP args, SEXP env)
     return R_lazyLoadDBinsertValue(value, file, ascii, compsxp, hook);
 }
 
+
+/*
+ * Lists with Separately Serialized Elements
+ */
+
+/* saveRDS(lazy = TRUE) writes a list with each of its elements
+   serialized, and optionally compressed, separately, so readRDS() can
+   return a lazy list (see altclasses.c) which reads an element from
+   the file only when it is used.  The file consists of
+
+       the magic number LIST_MAGIC
+       the elements
+       the index: a serialized list of the offsets of the elements
+         and of the index, the attributes of the list, and flags
+         giving the compression type, OBJECT and IS_S4_OBJECT
+       the offset of the index as an XDR double
+       the magic number again
+
+   Offsets are doubles so files can be larger than 2GB. */
+
+#define LIST_MAGIC "RDSL1\n"
+#define LIST_MAGIC_LEN 6
+#define LIST_TRAILER_LEN (8 + LIST_MAGIC_LEN)
+
+#ifdef Win32
+# define f_seek fseeko64
+# define f_tell ftello64
+# define OFF_T off64_t
+#elif defined(HAVE_OFF_T) && defined(HAVE_FSEEKO)
+# define f_seek fseeko
+# define f_tell ftello
+# define OFF_T off_t
+#else
+# define f_seek fseek
+# define f_tell ftell
+# define OFF_T long
+#endif
+
+static void listfile_cleanup(void *data)
+{
+    FILE *fp = (FILE *) data;
+    fclose(fp);
+}
+
+static void writeListBytes(FILE *fp, const void *buf, size_t len, double *pos)
+{
+    if (fwrite(buf, 1, len, fp) != len)
+	error(_("write failed"));
+    *pos += len;
+}
+
+static SEXP serializeListValue(SEXP value, SEXP type, SEXP version,
+			       SEXP hook, int compress)
+{
+    PROTECT_INDEX vpi;
+
+    value = R_serialize(value, R_NilValue, type, version, hook);
+    PROTECT_WITH_INDEX(value, &vpi);
+    if (compress == 3)
+	REPROTECT(value = R_compress3(value), vpi);
+    else if (compress == 2)
+	REPROTECT(value = R_compress2(value), vpi);
+    else if (compress)
+	REPROTECT(value = R_compress1(value), vpi);
+    UNPROTECT(1);
+    return value;
+}
+
+/* A lazy list's file must not change while elements are still to be
+   read from it, so it is identified by its size, device, inode and
+   modification time, which are checked before each read.  Sets id to
+   these for the file open as fp, returning FALSE on failure. */
+#define LIST_FILE_ID_LEN 5
+static Rboolean listFileId(FILE *fp, double *id)
+{
+    struct stat sb;
+    if (f_seek(fp, 0, SEEK_END) != 0 || fstat(fileno(fp), &sb) != 0)
+	return FALSE;
+    id[0] = (double) f_tell(fp);
+    id[1] = (double) sb.st_dev;
+    id[2] = (double) sb.st_ino;
+    id[3] = (double) sb.st_mtime;
+    id[4] = (double) MTIME_NS(sb);
+    return id[0] >= 0;
+}
+
+/* Reads len bytes at offset from the file identified by id. */
+static SEXP readListBytes(SEXP file, const double *id, double offset,
+			  double len)
+{
+    const char *cfile = translateChar(STRING_ELT(file, 0));
+    double size = id[0], cur[LIST_FILE_ID_LEN];
+    FILE *fp;
+
+    if (offset < 0 || len < 0 || offset + len > size || len > R_XLEN_T_MAX)
+	error(_("file '%s' is corrupt"), cfile);
+    SEXP val = PROTECT(allocVector(RAWSXP, (R_xlen_t) len));
+    if ((fp = RC_fopen(STRING_ELT(file, 0), "rb", TRUE)) == NULL)
+	error(_("cannot open file '%s': %s"), cfile, strerror(errno));
+    Rboolean changed = !listFileId(fp, cur);
+    for (int k = 0; k < LIST_FILE_ID_LEN && !changed; k++)
+	changed = cur[k] != id[k];
+    if (changed) {
+	fclose(fp);
+	error(_("file '%s' has changed since it was read"), cfile);
+    }
+    if (f_seek(fp, (OFF_T) offset, SEEK_SET) != 0) {
+	fclose(fp);
+	error(_("seek failed on %s"), cfile);
+    }
+    size_t in = fread(RAW(val), 1, (size_t) len, fp);
+    fclose(fp);
+    if ((size_t) len != in) error(_("read failed on %s"), cfile);
+    UNPROTECT(1);
+    return val;
+}
+
+/* serializeListToFile(object, file, type, version, hook, compress),
+   used from saveRDS(lazy = TRUE) */
+SEXP attribute_hidden
+do_serializeListToFile(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP object, file, type, version, hook, offsets, index, flags, val;
+    int compress;
+    double pos = 0;
+    char buf[8];
+    FILE *fp;
+    RCNTXT cntxt;
+
+    checkArity(op, args);
+    object = CAR(args); args = CDR(args);
+    file = CAR(args); args = CDR(args);
+    type = CAR(args); args = CDR(args);
+    version = CAR(args); args = CDR(args);
+    hook = CAR(args); args = CDR(args);
+    compress = asInteger(CAR(args));
+
+    if (TYPEOF(object) != VECSXP)
+	error(_("'%s' must be a list"), "object");
+    if (!isValidStringF(file))
+	error(_("'file' must be non-empty string"));
+    if (compress == NA_INTEGER || compress < 0 || compress > 3)
+	error(_("invalid '%s' argument"), "compress");
+
+    R_xlen_t n = XLENGTH(object);
+    PROTECT(offsets = allocVector(REALSXP, n + 1));
+
+    /* the file may be that of a lazy list in object */
+    R_force_lazy_lists(object);
+    fp = RC_fopen(STRING_ELT(file, 0), "wb", TRUE);
+    if (!fp)
+	error(_("cannot open file '%s': %s"),
+	      translateChar(STRING_ELT(file, 0)), strerror(errno));
+
+    /* set up a context which will close the file if there is an error */
+    begincontext(&cntxt, CTXT_CCODE, R_NilValue, R_BaseEnv, R_BaseEnv,
+		 R_NilValue, R_NilValue);
+    cntxt.cend = &listfile_cleanup;
+    cntxt.cenddata = fp;
+
+    writeListBytes(fp, LIST_MAGIC, LIST_MAGIC_LEN, &pos);
+    for (R_xlen_t i = 0; i < n; i++) {
+	REAL(offsets)[i] = pos;
+	val = serializeListValue(VECTOR_ELT(object, i), type, version, hook,
+				 compress);
+	writeListBytes(fp, RAW(val), XLENGTH(val), &pos);
+    }
+    REAL(offsets)[n] = pos;
+
+    PROTECT(index = allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(index, 0, offsets);
+    SET_VECTOR_ELT(index, 1, ATTRIB(object));
+    SET_VECTOR_ELT(index, 2, flags = allocVector(INTSXP, 3));
+    INTEGER(flags)[0] = compress;
+    INTEGER(flags)[1] = OBJECT(object);
+    INTEGER(flags)[2] = IS_S4_OBJECT(object) != 0;
+    val = serializeListValue(index, type, version, hook, 0);
+    writeListBytes(fp, RAW(val), XLENGTH(val), &pos);
+    R_XDREncodeDouble(REAL(offsets)[n], buf);
+    writeListBytes(fp, buf, 8, &pos);
+    writeListBytes(fp, LIST_MAGIC, LIST_MAGIC_LEN, &pos);
+
+    endcontext(&cntxt);
+    if (fclose(fp) != 0)
+	error(_("write failed"));
+    UNPROTECT(2); /* index, offsets */
+    return R_NilValue;
+}
+
+/* unserializeListFromFile(file, hook), used from readRDS().  Reads
+   the index and returns a lazy list. */
+SEXP attribute_hidden
+do_unserializeListFromFile(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP file, hook, val, index, offsets, flags, info, ans, id;
+    const char *cfile;
+    double size, ioff;
+    FILE *fp;
+
+    checkArity(op, args);
+    file = CAR(args);
+    hook = CADR(args);
+    if (!isValidStringF(file))
+	error(_("'file' must be non-empty string"));
+    cfile = translateChar(STRING_ELT(file, 0));
+
+    if ((fp = RC_fopen(STRING_ELT(file, 0), "rb", TRUE)) == NULL)
+	error(_("cannot open file '%s': %s"), cfile, strerror(errno));
+    PROTECT(id = allocVector(REALSXP, LIST_FILE_ID_LEN));
+    Rboolean ok = listFileId(fp, REAL(id));
+    fclose(fp);
+    if (!ok)
+	error(_("cannot read file '%s'"), cfile);
+    size = REAL(id)[0];
+    if (size < LIST_MAGIC_LEN + LIST_TRAILER_LEN)
+	error(_("file '%s' is corrupt"), cfile);
+    val = readListBytes(file, REAL(id), 0, LIST_MAGIC_LEN);
+    if (memcmp(RAW(val), LIST_MAGIC, LIST_MAGIC_LEN) != 0)
+	error(_("file '%s' is not a serialized list"), cfile);
+    val = readListBytes(file, REAL(id), size - LIST_TRAILER_LEN,
+			LIST_TRAILER_LEN);
+    if (memcmp(RAW(val) + 8, LIST_MAGIC, LIST_MAGIC_LEN) != 0)
+	error(_("file '%s' is corrupt"), cfile);
+    ioff = R_XDRDecodeDouble(RAW(val));
+    if (!(ioff >= LIST_MAGIC_LEN && ioff <= size - LIST_TRAILER_LEN))
+	error(_("file '%s' is corrupt"), cfile);
+
+    PROTECT(val = readListBytes(file, REAL(id), ioff,
+				size - LIST_TRAILER_LEN - ioff));
+    index = R_unserialize(val, hook);
+    UNPROTECT(1); /* val */
+    PROTECT(index);
+    if (TYPEOF(index) != VECSXP || XLENGTH(index) != 3 ||
+	TYPEOF(offsets = VECTOR_ELT(index, 0)) != REALSXP ||
+	XLENGTH(offsets) < 1 ||
+	TYPEOF(flags = VECTOR_ELT(index, 2)) != INTSXP ||
+	XLENGTH(flags) != 3)
+	error(_("file '%s' is corrupt"), cfile);
+    R_xlen_t n = XLENGTH(offsets) - 1;
+    if (REAL(offsets)[0] != LIST_MAGIC_LEN || REAL(offsets)[n] != ioff)
+	error(_("file '%s' is corrupt"), cfile);
+    for (R_xlen_t i = 0; i < n; i++)
+	if (!(REAL(offsets)[i] <= REAL(offsets)[i + 1]))
+	    error(_("file '%s' is corrupt"), cfile);
+
+    PROTECT(info = allocVector(VECSXP, 5));
+    SET_VECTOR_ELT(info, 0, ScalarString(STRING_ELT(file, 0)));
+    SET_VECTOR_ELT(info, 1, offsets);
+    SET_VECTOR_ELT(info, 2, id);
+    SET_VECTOR_ELT(info, 3, ScalarInteger(INTEGER(flags)[0]));
+    SET_VECTOR_ELT(info, 4, hook);
+    PROTECT(ans = R_lazy_list(info, n));
+    SET_ATTRIB(ans, VECTOR_ELT(index, 1));
+    SET_OBJECT(ans, INTEGER(flags)[1] != 0);
+    if (INTEGER(flags)[2])
+	SET_S4_OBJECT(ans);
+    UNPROTECT(4); /* ans, info, index, id */
+    return ans;
+}
+
+/* Reads element i of a lazy list with the information from
+   do_unserializeListFromFile */
+SEXP attribute_hidden R_unserializeListElt(SEXP info, R_xlen_t i)
+{
+    SEXP file = VECTOR_ELT(info, 0);
+    double *offsets = REAL(VECTOR_ELT(info, 1));
+    const double *id = REAL(VECTOR_ELT(info, 2));
+    int compressed = INTEGER(VECTOR_ELT(info, 3))[0];
+    PROTECT_INDEX vpi;
+    Rboolean err = FALSE;
+    SEXP val;
+
+    val = readListBytes(file, id, offsets[i], offsets[i + 1] - offsets[i]);
+    PROTECT_WITH_INDEX(val, &vpi);
+    if (compressed == 3)
+	REPROTECT(val = R_decompress3(val, &err), vpi);
+    else if (compressed == 2)
+	REPROTECT(val = R_decompress2(val, &err), vpi);
+    else if (compressed)
+	REPROTECT(val = R_decompress1(val, &err), vpi);
+    if (err) error(_("file '%s' is corrupt"),
+		   translateChar(STRING_ELT(file, 0)));
+    val = R_unserialize(val, VECTOR_ELT(info, 4));
+    UNPROTECT(1);
+    return val;
+}
+
 SEXP attribute_hidden
 do_serialize(SEXP call, SEXP op, SEXP args, SEXP env)
 {
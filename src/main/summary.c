@@ -47,12 +47,232 @@
 #define DbgP3(s,a,b)
 #endif
 
+/*
+  sum(), mean(), min() and max() of long integer, logical and double
+  vectors with a data pointer are reduced block by block: x is cut into
+  blocks of SUMMARY_BLOCK elements, each block is reduced on its own,
+  and the block results are combined in order.  The blocks do not
+  depend on the number of threads, and these reductions are exact, so
+  the result is the same however many are used.  The blocks are split
+  across getOption("summary.threads") threads, at most
+  R_max_num_math_threads; vectors shorter than SUMMARY_PAR_MIN use the
+  serial loops.
+
+  Sums and means of doubles are not exact: adding up per-block partial
+  sums rounds differently from the single running LDOUBLE sum of the
+  serial loops.  So they are only done in blocks when more than one
+  thread is to be used, and then the result can differ in the last bits
+  from that with one thread (but not between different numbers of
+  threads greater than one).
+*/
+#define SUMMARY_PAR_MIN 100000
+#define SUMMARY_BLOCK 16384
+#define SUMMARY_MAX_THREADS 64
+
+static const void *summary_blocked(SEXP x, int *nth, R_xlen_t *nb)
+{
+    R_xlen_t n = XLENGTH(x);
+    const void *px;
+    if (n < SUMMARY_PAR_MIN || (px = DATAPTR_OR_NULL(x)) == NULL)
+	return NULL;
+    *nth = 1;
+#ifdef _OPENMP
+    int nt = asInteger(GetOption1(install("summary.threads")));
+    if (nt > R_max_num_math_threads)
+	nt = R_max_num_math_threads;
+    if (nt != NA_INTEGER && nt > 1)
+	*nth = nt > SUMMARY_MAX_THREADS ? SUMMARY_MAX_THREADS : nt;
+#endif
+    *nb = (n + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+    return px;
+}
+
+#define BLOCK_RANGE(b, n, k0, k1)					\
+    R_xlen_t k0 = (b) * SUMMARY_BLOCK,					\
+	k1 = (n) - k0 < SUMMARY_BLOCK ? (n) : k0 + SUMMARY_BLOCK
+
+/* Sum of x[k] - shift, skipping NaNs if narm; *updated tells if any
+   element was used.  Each block is summed in order into one LDOUBLE
+   accumulator. */
+static LDOUBLE rsum_blocked(const double *x, R_xlen_t n, R_xlen_t nb,
+			    int nth, LDOUBLE shift, Rboolean narm,
+			    Rboolean *updated)
+{
+    const void *vmax = vmaxget();
+    LDOUBLE *bs = (LDOUBLE *) R_alloc(nb, sizeof(LDOUBLE));
+    char *bu = R_alloc(nb, sizeof(char));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (R_xlen_t b = 0; b < nb; b++) {
+	BLOCK_RANGE(b, n, k0, k1);
+	LDOUBLE bsum = 0.0;
+	if (narm) {
+	    char u = 0;
+	    for (R_xlen_t k = k0; k < k1; k++)
+		if (!ISNAN(x[k])) {
+		    bsum += x[k] - shift;
+		    u = 1;
+		}
+	    bu[b] = u;
+	} else {
+	    for (R_xlen_t k = k0; k < k1; k++)
+		bsum += x[k] - shift;
+	    bu[b] = 1;
+	}
+	bs[b] = bsum;
+    }
+
+    LDOUBLE s = 0.0;
+    Rboolean u = FALSE;
+    for (R_xlen_t b = 0; b < nb; b++) {
+	s += bs[b];
+	if (bu[b]) u = TRUE;
+    }
+    vmaxset(vmax);
+    *updated = u;
+    return s;
+}
+
+#ifdef LONG_INT
+/* As isum() below: returns NA_INTEGER if an NA is found and !narm,
+   42 if the sum might overflow LONG_INT, otherwise 'updated'. */
+static int isum_blocked(const int *x, R_xlen_t n, R_xlen_t nb, int nth,
+			LONG_INT *value, Rboolean narm)
+{
+    const void *vmax = vmaxget();
+    LONG_INT *bs = (LONG_INT *) R_alloc(nb, sizeof(LONG_INT));
+    char *bu = R_alloc(nb, sizeof(char));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (R_xlen_t b = 0; b < nb; b++) {
+	BLOCK_RANGE(b, n, k0, k1);
+	LONG_INT s = 0; // |s| < 2^31 * SUMMARY_BLOCK
+	char u = 0;
+	for (R_xlen_t k = k0; k < k1; k++)
+	    if (x[k] != NA_INTEGER) {
+		s += x[k];
+		u = 1;
+	    } else if (!narm) {
+		u = 2;
+		break;
+	    }
+	bs[b] = s;
+	bu[b] = u;
+    }
+
+    LONG_INT s = 0;
+    int updated = 0;
+    for (R_xlen_t b = 0; b < nb; b++) {
+	if (bu[b] == 2) {
+	    updated = NA_INTEGER;
+	    break;
+	}
+	if (bu[b]) updated = 1;
+	if (s > 9000000000000000000L || s < -9000000000000000000L) {
+	    updated = 42;
+	    break;
+	}
+	s += bs[b];
+    }
+    vmaxset(vmax);
+    *value = s;
+    return updated;
+}
+#endif
+
+/* min (if 'max' is false) or max of x, with the NA/NaN handling of
+   rmin() and rmax(): the first NA trumps everything, otherwise the last
+   NaN.  The loop over a block only counts the NaNs, which compare false
+   and so never replace m; blocks containing them are looked at again
+   after. */
+#define MINMAX_BETTER(a, b) (max ? (a) > (b) : (a) < (b))
+static R_INLINE double minmax_block(const double *x, R_xlen_t k0,
+				    R_xlen_t k1, Rboolean max,
+				    R_xlen_t *nnan)
+{
+    double m = max ? R_NegInf : R_PosInf;
+    R_xlen_t nn = 0;
+    for (R_xlen_t k = k0; k < k1; k++) {
+	double v = x[k];
+	if (MINMAX_BETTER(v, m)) m = v;
+	else if (ISNAN(v)) nn++;
+    }
+    *nnan = nn;
+    return m;
+}
+
+static Rboolean rminmax_blocked(const double *x, R_xlen_t n, R_xlen_t nb,
+				int nth, double *value, Rboolean narm,
+				Rboolean max)
+{
+    const void *vmax = vmaxget();
+    double *bm = (double *) R_alloc(nb, sizeof(double));
+    double *bnan = (double *) R_alloc(nb, sizeof(double));
+    char *bu = R_alloc(nb, sizeof(char));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nth) schedule(static)
+#endif
+    for (R_xlen_t b = 0; b < nb; b++) {
+	BLOCK_RANGE(b, n, k0, k1);
+	R_xlen_t nnan;
+	// constant 'max' arguments so each case gets its own loop
+	double m = max ? minmax_block(x, k0, k1, TRUE, &nnan) :
+	    minmax_block(x, k0, k1, FALSE, &nnan);
+	bm[b] = m;
+	bu[b] = nnan < k1 - k0; // some non-NaN
+	if (nnan && !narm) {
+	    double s = 0.0;
+	    for (R_xlen_t k = k0; k < k1; k++)
+		if (ISNAN(x[k])) {
+		    s = x[k];
+		    if (ISNA(s)) break;
+		}
+	    bnan[b] = s;
+	    bu[b] |= ISNA(s) ? 4 : 2;
+	} else
+	    bnan[b] = 0.0;
+    }
+
+    double s = 0.0;
+    Rboolean updated = FALSE, nan = FALSE;
+    for (R_xlen_t b = 0; b < nb; b++) {
+	if (bu[b] & 4) {
+	    s = bnan[b];
+	    updated = nan = TRUE;
+	    break;
+	}
+	if (bu[b] & 2) {
+	    s = bnan[b];
+	    updated = nan = TRUE;
+	}
+	else if (!nan && (bu[b] & 1) &&
+		 (!updated || MINMAX_BETTER(bm[b], s))) {
+	    s = bm[b];
+	    updated = TRUE;
+	}
+    }
+    vmaxset(vmax);
+    *value = s;
+    return updated;
+}
+#undef MINMAX_BETTER
+
 #ifdef LONG_INT
 # define isum_INT LONG_INT
 static int isum(SEXP sx, isum_INT *value, Rboolean narm, SEXP call)
 {
     LONG_INT s = 0;  // at least 64-bit
     int updated = 0;
+    int nth;
+    R_xlen_t nb;
+    const int *px = summary_blocked(sx, &nth, &nb);
+    if (px)
+	return isum_blocked(px, XLENGTH(sx), nb, nth, value, narm);
 #ifdef LONG_VECTOR_SUPPORT
     int ii = R_INT_MIN; // need > 2^32 entries to overflow; checking earlier is a waste
 /* NOTE: cannot use 64-bit *value to pass NA_INTEGER: that is "regular" 64bit int
@@ -153,15 +373,22 @@ static Rboolean rsum(SEXP sx, double *value, Rboolean narm)
 {
     LDOUBLE s = 0.0;
     Rboolean updated = FALSE;
+    int nth;
+    R_xlen_t nb;
+    const double *px = summary_blocked(sx, &nth, &nb);
 
-    ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
-	    for (R_xlen_t k = 0; k < nbatch; k++) {
-		if (!narm || !ISNAN(x[k])) {
-		    if(!updated) updated = TRUE;
-		    s += x[k];
+    if (px && nth > 1)
+	s = rsum_blocked(px, XLENGTH(sx), nb, nth, 0.0, narm, &updated);
+    else {
+	ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
+		for (R_xlen_t k = 0; k < nbatch; k++) {
+		    if (!narm || !ISNAN(x[k])) {
+			if(!updated) updated = TRUE;
+			s += x[k];
+		    }
 		}
-	    }
-	});
+	    });
+    }
     if(s > DBL_MAX) *value = R_PosInf;
     else if (s < -DBL_MAX) *value = R_NegInf;
     else *value = (double) s;
@@ -218,6 +445,12 @@ static Rboolean rmin(SEXP sx, double *value, Rboolean narm)
     Rboolean updated = FALSE;
 
     /* s = R_PosInf; */
+    int nth;
+    R_xlen_t nb;
+    const double *px = summary_blocked(sx, &nth, &nb);
+    if (px)
+	return rminmax_blocked(px, XLENGTH(sx), nb, nth, value, narm, FALSE);
+
     ITERATE_BY_REGION(sx, x, i, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (ISNAN(x[k])) {/* Na(N) */
@@ -288,6 +521,12 @@ static Rboolean rmax(SEXP sx, double *value, Rboolean narm)
     double s = 0.0 /* -Wall */;
     Rboolean updated = FALSE;
 
+    int nth;
+    R_xlen_t nb;
+    const double *px = summary_blocked(sx, &nth, &nb);
+    if (px)
+	return rminmax_blocked(px, XLENGTH(sx), nb, nth, value, narm, TRUE);
+
     ITERATE_BY_REGION(sx, x, iii, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++) {
 		if (ISNAN(x[k])) {/* Na(N) */
@@ -477,6 +716,17 @@ static R_INLINE SEXP real_mean(SEXP x)
 {
     R_xlen_t n = XLENGTH(x);
     LDOUBLE s = 0.0;
+    int nth;
+    R_xlen_t nb;
+    const double *px = summary_blocked(x, &nth, &nb);
+    if (px && nth > 1) {
+	Rboolean updated;
+	s = rsum_blocked(px, n, nb, nth, 0.0, FALSE, &updated);
+	s /= n;
+	if (R_FINITE((double) s))
+	    s += rsum_blocked(px, n, nb, nth, s, FALSE, &updated) / n;
+	return ScalarReal((double) s);
+    }
     ITERATE_BY_REGION(x, dx, i, nbatch, double, REAL, {
 	    for (R_xlen_t k = 0; k < nbatch; k++)
 		s += dx[k];
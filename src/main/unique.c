@@ -108,26 +108,32 @@ union foo {
     unsigned int u[2];
 };
 
-static R_INLINE hlen rhash(SEXP x, R_xlen_t indx, HashData *d)
+static R_INLINE hlen rhash_value(double xi, HashData *d)
 {
     /* There is a problem with signed 0s under IEC60559 */
-    double xi = REAL_ELT(x, indx);
     double tmp = (xi == 0.0) ? 0.0 : xi;
-    /* need to use both 32-byte chunks or endianness is an issue */
     /* we want all NaNs except NA equal, and all NAs equal */
     if (R_IsNA(tmp)) tmp = NA_REAL;
     else if (R_IsNaN(tmp)) tmp = R_NaN;
 #if 2*SIZEOF_INT == SIZEOF_DOUBLE
     {
-	union foo tmpu;
-	tmpu.d = tmp;
-	return scatter(tmpu.u[0] + tmpu.u[1], d);
+	/* Multiplicative hashing of all 64 bits: adding the two 32-bit
+	   halves first made many values collide, e.g. integers stored
+	   as doubles, whose low halves are all zero. */
+	uint64_t u;
+	memcpy(&u, &tmp, sizeof(u));
+	return (hlen) ((u * 11400714819323198485ULL) >> (64 - d->K));
     }
 #else
     return scatter(*((unsigned int *) (&tmp)), d);
 #endif
 }
 
+static R_INLINE hlen rhash(SEXP x, R_xlen_t indx, HashData *d)
+{
+    return rhash_value(REAL_ELT(x, indx), d);
+}
+
 static Rcomplex unify_complex_na(Rcomplex z) {
     Rcomplex ans;
     ans.r = (z.r == 0.0) ? 0.0 : z.r;
@@ -161,9 +167,9 @@ static hlen chash(SEXP x, R_xlen_t indx, HashData *d)
 
 /* Hash CHARSXP by address.  Hash values are int, For 64bit pointers,
  * we do (upper ^ lower) */
-static R_INLINE hlen cshash(SEXP x, R_xlen_t indx, HashData *d)
+static R_INLINE hlen cshash_value(SEXP s, HashData *d)
 {
-    intptr_t z = (intptr_t) STRING_ELT(x, indx);
+    intptr_t z = (intptr_t) s;
     unsigned int z1 = (unsigned int)(z & 0xffffffff), z2 = 0;
 #if SIZEOF_LONG == 8
     z2 = (unsigned int)(z/0x100000000L);
@@ -171,6 +177,11 @@ static R_INLINE hlen cshash(SEXP x, R_xlen_t indx, HashData *d)
     return scatter(z1 ^ z2, d);
 }
 
+static R_INLINE hlen cshash(SEXP x, R_xlen_t indx, HashData *d)
+{
+    return cshash_value(STRING_ELT(x, indx), d);
+}
+
 static R_INLINE hlen shash(SEXP x, R_xlen_t indx, HashData *d)
 {
     unsigned int k;
@@ -200,11 +211,8 @@ static R_INLINE int iequal(SEXP x, R_xlen_t i, SEXP y, R_xlen_t j)
 }
 
 /* BDR 2002-1-17  We don't want NA and other NaNs to be equal */
-static R_INLINE int requal(SEXP x, R_xlen_t i, SEXP y, R_xlen_t j)
+static R_INLINE int requal_value(double xi, double yj)
 {
-    if (i < 0 || j < 0) return 0;
-    double xi = REAL_ELT(x, i);
-    double yj = REAL_ELT(y, j);
     if (!ISNAN(xi) && !ISNAN(yj))
 	return (xi == yj);
     else if (R_IsNA(xi) && R_IsNA(yj)) return 1;
@@ -212,6 +220,12 @@ static R_INLINE int requal(SEXP x, R_xlen_t i, SEXP y, R_xlen_t j)
     else return 0;
 }
 
+static R_INLINE int requal(SEXP x, R_xlen_t i, SEXP y, R_xlen_t j)
+{
+    if (i < 0 || j < 0) return 0;
+    return requal_value(REAL_ELT(x, i), REAL_ELT(y, j));
+}
+
 /* This is differentiating {NA,1}, {NA,0}, {NA, NaN}, {NA, NA},
  * but R's print() and format()  render all as "NA" */
 static int cplx_eq(Rcomplex x, Rcomplex y)
@@ -459,6 +473,130 @@ static int isDuplicated(SEXP x, R_xlen_t indx, HashData *d)
     return 0;
 }
 
+/* Type-specialized loops running isDuplicated over a whole vector.
+   For integer, double and (hashed by address) string vectors with an
+   int hash table and accessible data, hashing and comparison are
+   inlined and the data are read directly, rather than through the
+   d->hash and d->equal function pointers for each element.  Hash
+   values are computed a small block at a time ahead of the probes of
+   the table, and the table slots they address are prefetched: for
+   large vectors the time is dominated by cache misses on the table,
+   and this lets several of them proceed at once.  (Storing keys
+   alongside the indices in the table, to save reading the data on a
+   hit, was tried but was slower as it doubles the size of the table.)
+
+   The results are stored in v unless it is NULL.  If 'stop' is true,
+   the scan stops at the first duplicate and returns its 1-based index;
+   otherwise (or if there is none) 0 is returned. */
+#define HASH_BLOCK 16
+#ifdef __GNUC__
+# define HASH_PREFETCH(p) __builtin_prefetch(p)
+#else
+# define HASH_PREFETCH(p)
+#endif
+
+#define DUPLICATED_PROBE(EQUAL) do {				\
+	hlen i = hv[k];						\
+	int dup = 0;						\
+	while (h[i] != NIL) {					\
+	    if (h[i] >= 0 && EQUAL(h[i], j)) {			\
+		dup = 1;					\
+		break;						\
+	    }							\
+	    i = (i + 1) % d->M;					\
+	}							\
+	if (!dup) {						\
+	    if (d->nmax-- < 0) error("hash table is full");	\
+	    h[i] = (int) j;					\
+	}							\
+	if (v) v[j] = dup;					\
+	if (dup && stop) return j + 1;				\
+    } while (0)
+
+#define DUPLICATED_SCAN(HASHVAL, EQUAL) do {				\
+	for (R_xlen_t b = 0; b < n; b += HASH_BLOCK) {			\
+	    R_xlen_t nb = n - b < HASH_BLOCK ? n - b : HASH_BLOCK;	\
+	    R_xlen_t j0 = from_last ? n - b - nb : b;			\
+	    for (R_xlen_t k = 0; k < nb; k++) {			\
+		hv[k] = HASHVAL(j0 + k);				\
+		HASH_PREFETCH(h + hv[k]);				\
+	    }								\
+	    if (from_last)						\
+		for (R_xlen_t k = nb - 1; k >= 0; k--) {		\
+		    R_xlen_t j = j0 + k;				\
+		    DUPLICATED_PROBE(EQUAL);				\
+		}							\
+	    else							\
+		for (R_xlen_t k = 0; k < nb; k++) {			\
+		    R_xlen_t j = j0 + k;				\
+		    DUPLICATED_PROBE(EQUAL);				\
+		}							\
+	}								\
+    } while (0)
+
+static R_xlen_t duplicatedScan(SEXP x, HashData *d, int *v,
+			       Rboolean from_last, Rboolean stop)
+{
+    R_xlen_t n = XLENGTH(x);
+    const void *px = DATAPTR_OR_NULL(x);
+    hlen hv[HASH_BLOCK];
+    Rboolean fast = px != NULL;
+#ifdef LONG_VECTOR_SUPPORT
+    if (d->isLong) fast = FALSE;
+#endif
+    if (TYPEOF(x) == STRSXP && (d->useUTF8 || !d->useCache))
+	fast = FALSE;
+
+    if (fast) {
+	int *h = HTDATA_INT(d);
+	unsigned int K = d->K;
+	switch (TYPEOF(x)) {
+	case INTSXP:
+	{
+	    const int *ix = (const int *) px;
+#define IHASHVAL(j) (ix[j] == NA_INTEGER ? 0 : \
+		     (hlen) (3141592653U * (unsigned int) ix[j] >> (32 - K)))
+#define IEQUAL(a, b) (ix[a] == ix[b])
+	    DUPLICATED_SCAN(IHASHVAL, IEQUAL);
+	    return 0;
+	}
+	case REALSXP:
+	{
+	    const double *rx = (const double *) px;
+#define RHASHVAL(j) rhash_value(rx[j], d)
+#define REQUAL(a, b) requal_value(rx[a], rx[b])
+	    DUPLICATED_SCAN(RHASHVAL, REQUAL);
+	    return 0;
+	}
+	case STRSXP:
+	{
+	    const SEXP *sx = (const SEXP *) px;
+#define SHASHVAL(j) cshash_value(sx[j], d)
+#define SEQUAL(a, b) (sx[a] == sx[b])
+	    DUPLICATED_SCAN(SHASHVAL, SEQUAL);
+	    return 0;
+	}
+	default:
+	    break;
+	}
+    }
+
+    if (from_last) {
+	for (R_xlen_t j = n - 1; j >= 0; j--) {
+	    int dup = isDuplicated(x, j, d);
+	    if (v) v[j] = dup;
+	    if (dup && stop) return j + 1;
+	}
+    } else {
+	for (R_xlen_t j = 0; j < n; j++) {
+	    int dup = isDuplicated(x, j, d);
+	    if (v) v[j] = dup;
+	    if (dup && stop) return j + 1;
+	}
+    }
+    return 0;
+}
+
 static Rboolean duplicatedInit(SEXP x, HashData *d)
 {
     Rboolean stop = FALSE;
@@ -533,7 +671,7 @@ SEXP duplicated(SEXP x, Rboolean from_last)
     int *v, nmax = NA_INTEGER;
 
     if (!isVector(x)) error(_("'duplicated' applies only to vectors"));
-    R_xlen_t i, n = XLENGTH(x);
+    R_xlen_t n = XLENGTH(x);
     DUPLICATED_INIT;
 
     PROTECT(data.HashTable);
@@ -541,16 +679,7 @@ SEXP duplicated(SEXP x, Rboolean from_last)
 
     v = LOGICAL(ans);
 
-    if(from_last)
-	for (i = n-1; i >= 0; i--) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
-    else
-	for (i = 0; i < n; i++) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
+    duplicatedScan(x, &data, v, from_last, FALSE);
 
     UNPROTECT(2);
     return ans;
@@ -562,7 +691,7 @@ static SEXP Duplicated(SEXP x, Rboolean from_last, int nmax)
     int *v;
 
     if (!isVector(x)) error(_("'duplicated' applies only to vectors"));
-    R_xlen_t i, n = XLENGTH(x);
+    R_xlen_t n = XLENGTH(x);
     DUPLICATED_INIT;
 
     PROTECT(data.HashTable);
@@ -570,16 +699,7 @@ static SEXP Duplicated(SEXP x, Rboolean from_last, int nmax)
 
     v = LOGICAL(ans);
 
-    if(from_last)
-	for (i = n-1; i >= 0; i--) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
-    else
-	for (i = 0; i < n; i++) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
+    duplicatedScan(x, &data, v, from_last, FALSE);
 
     UNPROTECT(2);
     return ans;
@@ -592,20 +712,11 @@ R_xlen_t any_duplicated(SEXP x, Rboolean from_last)
     int nmax = NA_INTEGER;
 
     if (!isVector(x)) error(_("'duplicated' applies only to vectors"));
-    R_xlen_t i, n = XLENGTH(x);
 
     DUPLICATED_INIT;
     PROTECT(data.HashTable);
 
-    if(from_last) {
-	for (i = n-1; i >= 0; i--) {
-	    if(isDuplicated(x, i, &data)) { result = ++i; break; }
-	}
-    } else {
-	for (i = 0; i < n; i++) {
-	    if(isDuplicated(x, i, &data)) { result = ++i; break; }
-	}
-    }
+    result = duplicatedScan(x, &data, NULL, from_last, TRUE);
     UNPROTECT(1);
     return result;
 }
@@ -624,16 +735,7 @@ static SEXP duplicated3(SEXP x, SEXP incomp, Rboolean from_last, int nmax)
 
     v = LOGICAL(ans);
 
-    if(from_last)
-	for (i = n-1; i >= 0; i--) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
-    else
-	for (i = 0; i < n; i++) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    v[i] = isDuplicated(x, i, &data);
-	}
+    duplicatedScan(x, &data, v, from_last, FALSE);
 
     if(length(incomp)) {
 	PROTECT(incomp = coerceVector(incomp, TYPEOF(x)));
@@ -812,11 +914,7 @@ SEXP attribute_hidden do_duplicated(SEXP call, SEXP op, SEXP args, SEXP env)
 /* Build a hash table, ignoring information on duplication */
 static void DoHashing(SEXP table, HashData *d)
 {
-    R_xlen_t i, n = XLENGTH(table);
-    for (i = 0; i < n; i++) {
-//	if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	(void) isDuplicated(table, i, d);
-    }
+    (void) duplicatedScan(table, d, NULL, FALSE, FALSE);
 }
 
 /* invalidate entries: normally few */
@@ -896,6 +994,113 @@ static SEXP match_transform(SEXP s, SEXP env)
     return duplicate(s);
 }
 
+/* Choose how strings are hashed from the elements of s, in order,
+   stopping at the first one that is in "bytes" encoding or not in the
+   CHARSXP cache. */
+static void scanStrings(SEXP s, Rboolean *useBytes, Rboolean *useUTF8,
+			Rboolean *useCache)
+{
+    for(R_xlen_t i = 0; i < xlength(s); i++) {
+	SEXP c = STRING_ELT(s, i);
+	if(IS_BYTES(c)) {
+	    *useBytes = TRUE;
+	    *useUTF8 = FALSE;
+	    break;
+	}
+	if(ENC_KNOWN(c)) {
+	    *useUTF8 = TRUE;
+	}
+	if(!IS_CACHED(c)) {
+	    *useCache = FALSE;
+	    break;
+	}
+    }
+}
+
+/* Cache of hash tables for the 'table' argument of match(), used when
+   options(match.cache = TRUE) for tables of length at least
+   MATCH_CACHE_MIN which are not objects.  R_MatchCache is a list of
+   MATCH_CACHE_SIZE slots, each NULL or an entry list of the table, the
+   table coerced for hashing (possibly the same object), its hash
+   table and a MatchCacheInfo in a raw vector.  A table is marked as
+   not mutable when it is cached, so any change to it at R level makes
+   a copy, which is not found in the cache.  The garbage collector
+   drops entries whose table is no longer otherwise reachable, so the
+   cache does not keep tables alive. */
+#define MATCH_CACHE_SIZE 8
+#define MATCH_CACHE_MIN 1000
+
+typedef struct {
+    SEXPTYPE type;	/* the type the table was coerced to */
+    HashData data;	/* as used to hash it */
+    Rboolean tbytes, tutf8, tcache; /* scanStrings() of the table alone */
+} MatchCacheInfo;
+
+static int R_MatchCacheNext = 0;
+
+static Rboolean useMatchCache(SEXP itable, SEXP incomp)
+{
+    return incomp == NULL && !OBJECT(itable) &&
+	XLENGTH(itable) >= MATCH_CACHE_MIN &&
+	asLogical(GetOption1(install("match.cache"))) == TRUE;
+}
+
+static SEXP findMatchCache(SEXP itable)
+{
+    if (R_MatchCache != NULL)
+	for (int i = 0; i < MATCH_CACHE_SIZE; i++) {
+	    SEXP e = VECTOR_ELT(R_MatchCache, i);
+	    if (e != R_NilValue && VECTOR_ELT(e, 0) == itable)
+		return e;
+	}
+    return NULL;
+}
+
+static void addMatchCache(SEXP itable, SEXP table, HashData *d,
+			  SEXPTYPE type)
+{
+    if (R_MatchCache == NULL)
+	R_MatchCache = allocVector(VECSXP, MATCH_CACHE_SIZE);
+
+    SEXP e = PROTECT(allocVector(VECSXP, 4));
+    SEXP raw = allocVector(RAWSXP, sizeof(MatchCacheInfo));
+    SET_VECTOR_ELT(e, 3, raw);
+    MatchCacheInfo *info = (MatchCacheInfo *) RAW0(raw);
+    info->type = type;
+    info->data = *d;
+    info->tbytes = FALSE;
+    info->tutf8 = FALSE;
+    info->tcache = TRUE;
+    if (type == STRSXP)
+	scanStrings(table, &info->tbytes, &info->tutf8, &info->tcache);
+    SET_VECTOR_ELT(e, 0, itable);
+    SET_VECTOR_ELT(e, 1, table);
+    SET_VECTOR_ELT(e, 2, d->HashTable);
+    MARK_NOT_MUTABLE(itable);
+    MARK_NOT_MUTABLE(table);
+
+    /* replace an entry for the same table, else use a free slot, else
+       replace entries in turn */
+    int i = 0;
+    while (i < MATCH_CACHE_SIZE) {
+	SEXP old = VECTOR_ELT(R_MatchCache, i);
+	if (old != R_NilValue && VECTOR_ELT(old, 0) == itable) break;
+	i++;
+    }
+    if (i == MATCH_CACHE_SIZE) {
+	i = 0;
+	while (i < MATCH_CACHE_SIZE &&
+	       VECTOR_ELT(R_MatchCache, i) != R_NilValue)
+	    i++;
+    }
+    if (i == MATCH_CACHE_SIZE) {
+	i = R_MatchCacheNext;
+	R_MatchCacheNext = (R_MatchCacheNext + 1) % MATCH_CACHE_SIZE;
+    }
+    SET_VECTOR_ELT(R_MatchCache, i, e);
+    UNPROTECT(1);
+}
+
 // workhorse of R's match() and hence also  " ix %in% itable "
 SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 {
@@ -913,6 +1118,45 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 
     int nprot = 0;
     SEXP x     = PROTECT(match_transform(ix,     env)); nprot++;
+
+    Rboolean cacheable = useMatchCache(itable, incomp);
+    SEXP centry = cacheable ? findMatchCache(itable) : NULL;
+    if (centry != NULL) {
+	/* Use the cached hash table if it was made for the type and
+	   string hashing method that would be used now. */
+	MatchCacheInfo *info = (MatchCacheInfo *) RAW0(VECTOR_ELT(centry, 3));
+	SEXPTYPE type;
+	if(TYPEOF(x) >= STRSXP || TYPEOF(itable) >= STRSXP) type = STRSXP;
+	else type = TYPEOF(x) < TYPEOF(itable) ? TYPEOF(itable) : TYPEOF(x);
+	if (type == info->type) {
+	    HashData data = info->data;
+	    Rboolean hit = TRUE;
+	    if (type == STRSXP) {
+		Rboolean useBytes = FALSE, useUTF8 = FALSE, useCache = TRUE;
+		scanStrings(x, &useBytes, &useUTF8, &useCache);
+		if (!useBytes || useCache) {
+		    /* as scanning the table after x */
+		    if (info->tbytes) {
+			useBytes = TRUE;
+			useUTF8 = FALSE;
+		    } else {
+			if (info->tutf8) useUTF8 = TRUE;
+			if (!info->tcache) useCache = FALSE;
+		    }
+		}
+		hit = useUTF8 == data.useUTF8 && useCache == data.useCache;
+	    }
+	    if (hit) {
+		PROTECT(x = coerceVector(x, type)); nprot++;
+		data.nomatch = nmatch;
+		data.HashTable = VECTOR_ELT(centry, 2);
+		SEXP ans = HashLookup(VECTOR_ELT(centry, 1), x, &data);
+		UNPROTECT(nprot);
+		return ans;
+	    }
+	}
+    }
+
     SEXP table = PROTECT(match_transform(itable, env)); nprot++;
     /* or should we use PROTECT_WITH_INDEX and REPROTECT below ? */
 
@@ -926,8 +1170,9 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
     PROTECT(x	  = coerceVector(x,	type)); nprot++;
     PROTECT(table = coerceVector(table, type)); nprot++;
 
-    // special case scalar x -- for speed only :
-    if(XLENGTH(x) == 1 && !incomp) {
+    // special case scalar x -- for speed only, unless hashing the table
+    // for the cache, so that repeated scalar lookups use it :
+    if(XLENGTH(x) == 1 && !incomp && !cacheable) {
       int val = nmatch;
       int ntable = LENGTH(table);
       switch (type) {
@@ -994,44 +1239,18 @@ SEXP match5(SEXP itable, SEXP ix, int nmatch, SEXP incomp, SEXP env)
 	    Rboolean useBytes = FALSE;
 	    Rboolean useUTF8 = FALSE;
 	    Rboolean useCache = TRUE;
-	    for(R_xlen_t i = 0; i < xlength(x); i++) {
-		SEXP s = STRING_ELT(x, i);
-		if(IS_BYTES(s)) {
-		    useBytes = TRUE;
-		    useUTF8 = FALSE;
-		    break;
-		}
-		if(ENC_KNOWN(s)) {
-		    useUTF8 = TRUE;
-		}
-		if(!IS_CACHED(s)) {
-		    useCache = FALSE;
-		    break;
-		}
-	    }
-	    if(!useBytes || useCache) {
-		for(int i = 0; i < LENGTH(table); i++) {
-		    SEXP s = STRING_ELT(table, i);
-		    if(IS_BYTES(s)) {
-			useBytes = TRUE;
-			useUTF8 = FALSE;
-			break;
-		    }
-		    if(ENC_KNOWN(s)) {
-			useUTF8 = TRUE;
-		    }
-		    if(!IS_CACHED(s)) {
-			useCache = FALSE;
-			break;
-		    }
-		}
-	    }
+	    scanStrings(x, &useBytes, &useUTF8, &useCache);
+	    if(!useBytes || useCache)
+		scanStrings(table, &useBytes, &useUTF8, &useCache);
 	    data.useUTF8 = useUTF8;
 	    data.useCache = useCache;
 	}
 	PROTECT(data.HashTable); nprot++;
 	DoHashing(table, &data);
 	if (incomp) UndoHashing(incomp, table, &data);
+	if (cacheable)
+	    addMatchCache(itable, TYPEOF(itable) == type ? itable : table,
+			  &data, type);
 	ans = HashLookup(table, x, &data);
     }
     UNPROTECT(nprot);